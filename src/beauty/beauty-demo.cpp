@@ -3,6 +3,9 @@
 #include "../common/viz2d.hpp"
 #include "../common/nvg.hpp"
 #include "../common/util.hpp"
+#include "../common/framegraph.hpp"
+#include "../common/framearena.hpp"
+#include "../common/effects.hpp"
 
 #include <vector>
 #include <string>
@@ -20,6 +23,8 @@ constexpr double SCALE = 0.125;
 constexpr bool OFFSCREEN = false;
 constexpr const char *OUTPUT_FILENAME = "beauty-demo.mkv";
 constexpr int VA_HW_DEVICE_INDEX = 0;
+constexpr size_t PREFETCH_DEPTH = 3;
+constexpr size_t WRITER_QUEUE_DEPTH = 3;
 const unsigned long DIAG = hypot(double(WIDTH), double(HEIGHT));
 
 /** Effect parameters **/
@@ -178,156 +183,178 @@ void draw_face_fg_mask(const vector<FaceFeatures> &lm) {
     }
 }
 
-void reduce_shadows(const cv::UMat &srcBGR, cv::UMat &dstBGR, double to_percent) {
-    assert(srcBGR.type() == CV_8UC3);
-    static cv::UMat hsv;
-    static vector<cv::UMat> hsvChannels;
-    static cv::UMat valueFloat;
-
-    cvtColor(srcBGR, hsv, cv::COLOR_BGR2HSV);
-    cv::split(hsv, hsvChannels);
-    hsvChannels[2].convertTo(valueFloat, CV_32F, 1.0 / 255.0);
-
-    double minIn, maxIn;
-    cv::minMaxLoc(valueFloat, &minIn, &maxIn);
-    cv::subtract(valueFloat, minIn, valueFloat);
-    cv::divide(valueFloat, cv::Scalar::all(maxIn - minIn), valueFloat);
-    double minOut = (minIn + (1.0 * (to_percent / 100.0)));
-    cv::multiply(valueFloat, cv::Scalar::all(1.0 - minOut), valueFloat);
-    cv::add(valueFloat, cv::Scalar::all(minOut), valueFloat);
-
-    valueFloat.convertTo(hsvChannels[2], CV_8U, 255.0);
-    cv::merge(hsvChannels, hsv);
-    cvtColor(hsv, dstBGR, cv::COLOR_HSV2BGR);
-}
-
-void unsharp_mask(const cv::UMat &src, cv::UMat &dst, const float strength) {
-    static cv::UMat blurred;
-    cv::medianBlur(src, blurred, 3);
-    cv::UMat laplacian;
-    cv::Laplacian(blurred, laplacian, CV_8U);
-    cv::multiply(laplacian, cv::Scalar::all(strength), laplacian);
-    cv::subtract(src, laplacian, dst);
-}
-
 static cv::Ptr<cv::face::Facemark> facemark = cv::face::createFacemarkLBF();
 
-void iteration() {
-    try {
+void build_graph() {
+    using kb::viz2d::FrameGraph;
     static cv::Ptr<cv::FaceDetectorYN> detector = cv::FaceDetectorYN::create("assets/face_detection_yunet_2022mar.onnx", "", cv::Size(v2d->getFrameBufferSize().width * SCALE, v2d->getFrameBufferSize().height * SCALE), 0.9, 0.3, 5000, cv::dnn::DNN_BACKEND_OPENCV, cv::dnn::DNN_TARGET_OPENCL);
     //FIXME try FeatherBlender
     static cv::detail::MultiBandBlender blender(true);
+    FrameGraph& graph = v2d->graph();
+    //the buffers are taken from the frame arena by the stage that writes them
     //BGR
-    static cv::UMat rgb, down, faceBgMask, diff, blurred, reduced, sharpened, masked;
-    static cv::UMat frameOut(HEIGHT, WIDTH, CV_8UC3);
-    static cv::UMat lhalf(HEIGHT * SCALE, WIDTH * SCALE, CV_8UC3);
-    static cv::UMat rhalf(lhalf.size(), lhalf.type());
+    static cv::UMat& rgb = graph.buf("rgb");
+    static cv::UMat& down = graph.buf("down");
+    static cv::UMat& blurred = graph.buf("blurred");
+    static cv::UMat& reduced = graph.buf("reduced");
+    static cv::UMat& sharpened = graph.buf("sharpened");
+    static cv::UMat& frameOut = graph.buf("frameOut");
     //GREY
-    static cv::UMat downGrey, faceBgMaskGrey, faceBgMaskInvGrey, faceFgMaskGrey;
+    static cv::UMat& downGrey = graph.buf("downGrey");
+    static cv::UMat& faceBgMaskGrey = graph.buf("faceBgMaskGrey");
+    static cv::UMat& faceBgMaskInvGrey = graph.buf("faceBgMaskInvGrey");
+    static cv::UMat& faceFgMaskGrey = graph.buf("faceFgMaskGrey");
     //BGR-Float
     static cv::UMat frameOutFloat;
 
     static cv::Mat faces;
+    //host copies for the landmark stage
+    static cv::Mat downGreyMat;
     static vector<cv::Rect> faceRects;
     static vector<vector<cv::Point2f>> shapes;
     static vector<FaceFeatures> featuresList;
 
 #ifndef __EMSCRIPTEN__
-    if(!v2d->capture())
-        exit(0);
+    graph.capture();
 #endif
 
-    v2d->clgl([&](cv::UMat &frameBuffer) {
+    graph.clgl("rgb", {}, {"rgb"}, [&](cv::UMat &frameBuffer) {
+        v2d->graph().acquire("rgb", frameBuffer.size(), CV_8UC3);
         cvtColor(frameBuffer, rgb, cv::COLOR_BGRA2RGB);
+    }, cv::ACCESS_READ);
+
+    graph.cl("downscale", {"rgb"}, {"down", "downGrey"}, [&]() {
+        cv::Size downSize(cvRound(rgb.cols * SCALE), cvRound(rgb.rows * SCALE));
+        v2d->graph().acquire("down", downSize, CV_8UC3);
+        v2d->graph().acquire("downGrey", downSize, CV_8UC1);
+        cv::resize(rgb, down, downSize);
+        cvtColor(down, downGrey, cv::COLOR_BGRA2GRAY);
     });
 
-    cv::resize(rgb, down, cv::Size(0, 0), SCALE, SCALE);
-    cvtColor(down, downGrey, cv::COLOR_BGRA2GRAY);
-    detector->detect(down, faces);
-
-    faceRects.clear();
-    for (int i = 0; i < faces.rows; i++) {
-        faceRects.push_back(cv::Rect(int(faces.at<float>(i, 0)), int(faces.at<float>(i, 1)), int(faces.at<float>(i, 2)), int(faces.at<float>(i, 3))));
-    }
+    //the masks are drawn from the faces of the same frame
+    graph.cl("detect faces", {"down", "downGrey"}, {"faces"}, [&]() {
+        detector->detect(down, faces);
 
-    shapes.clear();
+        faceRects.clear();
+        for (int i = 0; i < faces.rows; i++) {
+            faceRects.push_back(cv::Rect(int(faces.at<float>(i, 0)), int(faces.at<float>(i, 1)), int(faces.at<float>(i, 2)), int(faces.at<float>(i, 3))));
+        }
+        //download here. the CPU stage runs on another thread and shouldn't touch OpenCL buffers.
+        if (!faceRects.empty())
+            downGrey.copyTo(downGreyMat);
+    });
 
-    if (!faceRects.empty() && facemark->fit(downGrey, faceRects, shapes)) {
+    //Fit the landmarks on the pool. overlaps with blurring and sharpening. Facemark::fit keeps the current face in the
+    //instance, so the faces can't be split across threads with parallelFor.
+    graph.cpu("fit landmarks", {"faces"}, {"features"}, [&]() {
+        shapes.clear();
         featuresList.clear();
-        for (size_t i = 0; i < faceRects.size(); ++i) {
-            featuresList.push_back(FaceFeatures(faceRects[i], shapes[i], float(down.size().width) / WIDTH));
+        if (!faceRects.empty() && facemark->fit(downGreyMat, faceRects, shapes)) {
+            for (size_t i = 0; i < faceRects.size(); ++i) {
+                featuresList.push_back(FaceFeatures(faceRects[i], shapes[i], float(downGreyMat.cols) / WIDTH));
+            }
         }
+    });
 
-        v2d->nvg([&](const cv::Size& sz) {
-            v2d->clear();
-            //Draw the face background mask (= face oval)
-            draw_face_bg_mask(featuresList);
-        });
-
-        v2d->clgl([&](cv::UMat &frameBuffer) {
-            //Convert/Copy the mask
-            cvtColor(frameBuffer, faceBgMask, cv::COLOR_BGRA2BGR);
-            cvtColor(frameBuffer, faceBgMaskGrey, cv::COLOR_BGRA2GRAY);
-        });
-
-        v2d->nvg([&](const cv::Size& sz) {
-            v2d->clear();
-            //Draw the face forground mask (= eyes and outer lips)
-            draw_face_fg_mask(featuresList);
-        });
+    graph.nvg("face bg mask", {"features"}, {}, [&](const cv::Size& sz) {
+        if (featuresList.empty())
+            return;
+        v2d->clear();
+        //Draw the face background mask (= face oval)
+        draw_face_bg_mask(featuresList);
+    });
 
-        v2d->clgl([&](cv::UMat &frameBuffer) {
-            //Convert/Copy the mask
-            cvtColor(frameBuffer, faceFgMaskGrey, cv::COLOR_BGRA2GRAY);
-        });
+    graph.clgl("copy bg mask", {"features"}, {"faceBgMaskGrey"}, [&](cv::UMat &frameBuffer) {
+        if (featuresList.empty())
+            return;
+        //Convert/Copy the mask
+        v2d->graph().acquire("faceBgMaskGrey", frameBuffer.size(), CV_8UC1);
+        cvtColor(frameBuffer, faceBgMaskGrey, cv::COLOR_BGRA2GRAY);
+    }, cv::ACCESS_READ);
+
+    graph.nvg("face fg mask", {"features"}, {}, [&](const cv::Size& sz) {
+        if (featuresList.empty())
+            return;
+        v2d->clear();
+        //Draw the face forground mask (= eyes and outer lips)
+        draw_face_fg_mask(featuresList);
+    });
 
+    graph.clgl("copy fg mask", {"features"}, {"faceFgMaskGrey"}, [&](cv::UMat &frameBuffer) {
+        if (featuresList.empty())
+            return;
+        //Convert/Copy the mask
+        v2d->graph().acquire("faceFgMaskGrey", frameBuffer.size(), CV_8UC1);
+        cvtColor(frameBuffer, faceFgMaskGrey, cv::COLOR_BGRA2GRAY);
+    }, cv::ACCESS_READ);
+
+    graph.cl("masks", {"features", "faceBgMaskGrey", "faceFgMaskGrey"}, {"faceBgMaskGrey", "faceFgMaskGrey", "faceBgMaskInvGrey"}, [&]() {
+        if (featuresList.empty())
+            return;
         //Dilate the face forground mask to make eyes and mouth areas wider
         int morph_size = 1;
         cv::Mat element = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2 * morph_size + 1, 2 * morph_size + 1), cv::Point(morph_size, morph_size));
         cv::morphologyEx(faceFgMaskGrey, faceFgMaskGrey, cv::MORPH_DILATE, element, cv::Point(element.cols >> 1, element.rows >> 1), DILATE_ITERATIONS, cv::BORDER_CONSTANT, cv::morphologyDefaultBorderValue());
 
         cv::subtract(faceBgMaskGrey, faceFgMaskGrey, faceBgMaskGrey);
+        v2d->graph().acquire("faceBgMaskInvGrey", faceBgMaskGrey.size(), CV_8UC1);
         cv::bitwise_not(faceBgMaskGrey, faceBgMaskInvGrey);
+    });
 
-        reduce_shadows(rgb, reduced, REDUCE_SHADOW);
+    //blurring and sharpening only need the detected faces
+    graph.cl("blur", {"faces", "rgb"}, {"blurred", "reduced"}, [&]() {
+        if (faceRects.empty())
+            return;
+        v2d->graph().acquire("reduced", rgb.size(), rgb.type());
+        v2d->graph().acquire("blurred", rgb.size(), rgb.type());
+        kb::viz2d::reduce_shadows(v2d->arena(), rgb, reduced, REDUCE_SHADOW);
         cv::boxFilter(reduced, blurred, -1, cv::Size(BLUR_KERNEL_SIZE, BLUR_KERNEL_SIZE), cv::Point(-1, -1), true, cv::BORDER_REPLICATE);
+    });
+
+    graph.cl("sharpen", {"faces", "rgb"}, {"sharpened"}, [&]() {
+        if (faceRects.empty())
+            return;
+        v2d->graph().acquire("sharpened", rgb.size(), rgb.type());
+        kb::viz2d::unsharp_mask(v2d->arena(), rgb, sharpened, UNSHARP_STRENGTH);
+    });
 
-        unsharp_mask(rgb, sharpened, UNSHARP_STRENGTH);
+    graph.cl("blend", {"features", "blurred", "sharpened", "faceBgMaskGrey", "faceBgMaskInvGrey"}, {"frameOut"}, [&]() {
+        if (featuresList.empty())
+            return;
         blender.prepare(cv::Rect(0, 0, WIDTH, HEIGHT));
         blender.feed(blurred, faceBgMaskGrey, cv::Point(0, 0));
         blender.feed(sharpened, faceBgMaskInvGrey, cv::Point(0, 0));
         blender.blend(frameOutFloat, cv::UMat());
+        v2d->graph().acquire("frameOut", frameOutFloat.size(), CV_8UC3);
         frameOutFloat.convertTo(frameOut, CV_8U, 1.0);
+    });
 
-//        cv::resize(rgb, lhalf, cv::Size(0, 0), 0.5, 0.5);
-//        cv::resize(frameOut, rhalf, cv::Size(0, 0), 0.5, 0.5);
-//
-//        frameOut = cv::Scalar::all(0);
-//        lhalf.copyTo(frameOut(cv::Rect(0, 0, lhalf.size().width, lhalf.size().height)));
-//        rhalf.copyTo(frameOut(cv::Rect(rhalf.size().width, 0, rhalf.size().width, rhalf.size().height)));
-
-        v2d->clgl([&](cv::UMat &frameBuffer) {
-            cvtColor(frameOut, frameBuffer, cv::COLOR_RGB2BGRA);
-        });
-    } else {
-        v2d->clgl([&](cv::UMat &frameBuffer) {
-//            frameOut = cv::Scalar::all(0);
-//            cv::resize(rgb, lhalf, cv::Size(0, 0), 0.5, 0.5);
-//            lhalf.copyTo(frameOut(cv::Rect(0, 0, lhalf.size().width, lhalf.size().height)));
-//            lhalf.copyTo(frameOut(cv::Rect(lhalf.size().width, 0, lhalf.size().width, lhalf.size().height)));
+    graph.clgl("output", {"features", "rgb", "frameOut"}, {}, [&](cv::UMat &frameBuffer) {
+        if (featuresList.empty())
             cvtColor(rgb, frameBuffer, cv::COLOR_RGB2BGRA);
-        });
-    }
+        else
+            cvtColor(frameOut, frameBuffer, cv::COLOR_RGB2BGRA);
+    }, cv::ACCESS_WRITE);
 
-    update_fps(v2d, true);
+    graph.task("fps", {FrameGraph::FRAMEBUFFER}, {FrameGraph::FRAMEBUFFER}, [&]() {
+        update_fps(v2d, true);
+    });
 
 #ifndef __EMSCRIPTEN__
-    v2d->write();
+    graph.write();
 #endif
 
     //If onscreen rendering is enabled it displays the framebuffer in the native window. Returns false if the window was closed.
-    if(!v2d->display())
-        exit(0);
+    graph.display();
+}
+
+void iteration() {
+    try {
+        if (v2d->graph().empty())
+            build_graph();
+
+        if(!v2d->graph().run())
+            exit(0);
     } catch(std::exception& ex){
         cerr << ex.what() << endl;
         exit(1);
@@ -351,6 +378,7 @@ int main(int argc, char **argv) {
 
 #ifndef __EMSCRIPTEN__
     auto capture = v2d->makeVACapture(argv[1], VA_HW_DEVICE_INDEX);
+    v2d->setPrefetchDepth(PREFETCH_DEPTH);
 
     if (!capture.isOpened()) {
         cerr << "ERROR! Unable to open video input" << endl;
@@ -361,6 +389,7 @@ int main(int argc, char **argv) {
     float width = capture.get(cv::CAP_PROP_FRAME_WIDTH);
     float height = capture.get(cv::CAP_PROP_FRAME_HEIGHT);
     v2d->makeVAWriter(OUTPUT_FILENAME, cv::VideoWriter::fourcc('V', 'P', '9', '0'), fps, v2d->getFrameBufferSize(), VA_HW_DEVICE_INDEX);
+    v2d->setAsyncWrite(WRITER_QUEUE_DEPTH);
 
 
     while (true)
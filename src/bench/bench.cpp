@@ -0,0 +1,371 @@
+#include "kernels.hpp"
+#include "../common/effects.hpp"
+#include "../common/analysis.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
+#include <opencv2/imgproc.hpp>
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+constexpr size_t WARMUP = 10;
+constexpr size_t ITERATIONS = 100;
+//the seed of all synthetic frames. results are only comparable between runs with the same content.
+constexpr uint64_t SEED = 0x5eed;
+
+using kernel_t = std::function<void(kb::viz2d::FrameArena&)>;
+
+struct Benchmark {
+    string name_;
+    //prepares the input of one frame size and returns the code to measure
+    std::function<kernel_t(const cv::Size&)> setup_;
+};
+
+struct Result {
+    double mean_ = 0;
+    double median_ = 0;
+    double min_ = 0;
+    double max_ = 0;
+    double stddev_ = 0;
+};
+
+//noise with filled circles on top, so feature detection and optical flow find something to work with. offset moves the circles.
+static cv::UMat make_frame(const cv::Size& sz, int type, const cv::Point& offset = cv::Point()) {
+    cv::RNG rng(SEED);
+    cv::Mat bgr(sz, CV_8UC3);
+    rng.fill(bgr, cv::RNG::UNIFORM, 0, 64);
+    int maxRadius = std::max(std::min(sz.width, sz.height) / 20, 2);
+    for (int i = 0; i < 64; ++i) {
+        cv::Point center(rng.uniform(0, sz.width), rng.uniform(0, sz.height));
+        cv::Scalar color(rng.uniform(64, 256), rng.uniform(64, 256), rng.uniform(64, 256));
+        cv::circle(bgr, center + offset, rng.uniform(1, maxRadius), color, cv::FILLED);
+    }
+
+    cv::UMat frame;
+    switch (type) {
+    case CV_8UC1:
+        cv::cvtColor(bgr, frame, cv::COLOR_BGR2GRAY);
+        break;
+    case CV_8UC4:
+        cv::cvtColor(bgr, frame, cv::COLOR_BGR2BGRA);
+        break;
+    default:
+        bgr.copyTo(frame);
+        break;
+    }
+    return frame;
+}
+
+//the kernel size the demos derive from the frame size
+static int kernel_size(const cv::Size& sz) {
+    int diag = std::hypot(sz.width, sz.height);
+    return std::max(int(diag / 150 % 2 == 0 ? diag / 150 + 1 : diag / 150), 1);
+}
+
+using effect_t = std::function<void(kb::viz2d::FrameArena&, const cv::UMat&, cv::UMat&)>;
+
+//the largest and the mean per channel difference between a reference and an optimized implementation
+static void report_difference(const string& name, const cv::Size& sz, const cv::UMat& src, effect_t reference, effect_t optimized) {
+    kb::viz2d::FrameArena arena;
+    cv::UMat expected, actual, diff;
+    reference(arena, src, expected);
+    optimized(arena, src, actual);
+    cv::absdiff(expected, actual, diff);
+    double maxDiff = 0;
+    cv::minMaxLoc(diff.reshape(1), nullptr, &maxDiff);
+    cv::Scalar mean = cv::mean(diff);
+    double meanDiff = (mean[0] + mean[1] + mean[2] + mean[3]) / diff.channels();
+    cerr << name << " " << sz << ": max difference to the reference " << maxDiff << ", mean " << meanDiff << endl;
+}
+
+static vector<Benchmark> make_benchmarks() {
+    using kb::viz2d::FrameArena;
+    vector<Benchmark> benchmarks;
+
+    //what CLGLContext::acquireFromGL/releaseToGL used to spend on flipping the framebuffer on every clgl() call
+    benchmarks.push_back({ "flip", [](const cv::Size& sz) -> kernel_t {
+        cv::UMat frameBuffer = make_frame(sz, CV_8UC4);
+        return [=](FrameArena& arena) mutable {
+            cv::flip(frameBuffer, frameBuffer, 0);
+            cv::flip(frameBuffer, frameBuffer, 0);
+        };
+    } });
+
+    benchmarks.push_back({ "glow_effect", [](const cv::Size& sz) -> kernel_t {
+        cv::UMat src = make_frame(sz, CV_8UC4);
+        cv::UMat dst;
+        int ksize = kernel_size(sz);
+        return [=](FrameArena& arena) mutable {
+            bench::glow_effect(arena, src, dst, ksize);
+        };
+    } });
+
+    benchmarks.push_back({ "glow_effect_fused", [](const cv::Size& sz) -> kernel_t {
+        cv::UMat src = make_frame(sz, CV_8UC4);
+        cv::UMat dst;
+        int ksize = kernel_size(sz);
+        report_difference("glow_effect_fused", sz, src, [=](FrameArena& arena, const cv::UMat& s, cv::UMat& d) {
+            bench::glow_effect(arena, s, d, ksize);
+        }, [=](FrameArena& arena, const cv::UMat& s, cv::UMat& d) {
+            kb::viz2d::glow_effect(arena, s, d, ksize);
+        });
+        return [=](FrameArena& arena) mutable {
+            kb::viz2d::glow_effect(arena, src, dst, ksize);
+        };
+    } });
+
+    benchmarks.push_back({ "bloom", [](const cv::Size& sz) -> kernel_t {
+        cv::UMat src = make_frame(sz, CV_8UC4);
+        cv::UMat dst;
+        int ksize = kernel_size(sz);
+        return [=](FrameArena& arena) mutable {
+            bench::bloom(arena, src, dst, ksize);
+        };
+    } });
+
+    benchmarks.push_back({ "bloom_fused", [](const cv::Size& sz) -> kernel_t {
+        cv::UMat src = make_frame(sz, CV_8UC4);
+        cv::UMat dst;
+        int ksize = kernel_size(sz);
+        report_difference("bloom_fused", sz, src, [=](FrameArena& arena, const cv::UMat& s, cv::UMat& d) {
+            bench::bloom(arena, s, d, ksize);
+        }, [=](FrameArena& arena, const cv::UMat& s, cv::UMat& d) {
+            kb::viz2d::bloom_effect(arena, s, d, ksize);
+        });
+        return [=](FrameArena& arena) mutable {
+            kb::viz2d::bloom_effect(arena, src, dst, ksize);
+        };
+    } });
+
+    benchmarks.push_back({ "prepare_background", [](const cv::Size& sz) -> kernel_t {
+        cv::UMat src = make_frame(sz, CV_8UC4);
+        cv::UMat background;
+        return [=](FrameArena& arena) mutable {
+            src.copyTo(background);
+            kb::viz2d::prepare_background(arena, background, kb::viz2d::GREY);
+        };
+    } });
+
+    benchmarks.push_back({ "composite_layers", [](const cv::Size& sz) -> kernel_t {
+        cv::UMat background = make_frame(sz, CV_8UC4);
+        cv::UMat foreground = make_frame(sz, CV_8UC4, cv::Point(8, 8));
+        cv::UMat frameBuffer(sz, CV_8UC4, cv::Scalar::all(0));
+        int ksize = kernel_size(sz);
+        return [=](FrameArena& arena) mutable {
+            //the optflow demo defaults
+            kb::viz2d::composite_layers(arena, background, foreground, frameBuffer, frameBuffer, ksize, 2.5, kb::viz2d::GLOW, 210, 3.0f);
+        };
+    } });
+
+    //the optflow demo works on the frame scaled down by half
+    benchmarks.push_back({ "prepare_motion_mask", [](const cv::Size& sz) -> kernel_t {
+        cv::UMat grey[2] = { make_frame(sz / 2, CV_8UC1), make_frame(sz / 2, CV_8UC1, cv::Point(4, 4)) };
+        cv::UMat mask;
+        kb::viz2d::MotionDetector detector;
+        size_t i = 0;
+        return [=](FrameArena& arena) mutable {
+            detector.mask(grey[i++ % 2], mask);
+        };
+    } });
+
+    benchmarks.push_back({ "detect_points", [](const cv::Size& sz) -> kernel_t {
+        cv::Mat mask = make_frame(sz / 2, CV_8UC1).getMat(cv::ACCESS_READ).clone();
+        cv::threshold(mask, mask, 63, 255, cv::THRESH_BINARY);
+        vector<cv::Point2f> points;
+        return [=](FrameArena& arena) mutable {
+            kb::viz2d::detect_points(mask, points);
+        };
+    } });
+
+    benchmarks.push_back({ "detect_scene_change", [](const cv::Size& sz) -> kernel_t {
+        cv::UMat mask = make_frame(sz / 2, CV_8UC1);
+        cv::threshold(mask, mask, 63, 255, cv::THRESH_BINARY);
+        kb::viz2d::MotionDetector detector;
+        return [=](FrameArena& arena) mutable {
+            detector.detectSceneChange(mask, 1.0, 1.0);
+        };
+    } });
+
+    benchmarks.push_back({ "sparse_optical_flow", [](const cv::Size& sz) -> kernel_t {
+        cv::UMat grey[2] = { make_frame(sz / 2, CV_8UC1), make_frame(sz / 2, CV_8UC1, cv::Point(4, 4)) };
+        cv::Mat mask;
+        cv::threshold(grey[0].getMat(cv::ACCESS_READ), mask, 63, 255, cv::THRESH_BINARY);
+        vector<cv::Point2f> points;
+        kb::viz2d::detect_points(mask, points);
+        kb::viz2d::SparseOpticalFlow flow(SEED);
+        vector<cv::Vec4f> lines;
+        size_t i = 0;
+        return [=](FrameArena& arena) mutable {
+            flow.track(grey[i % 2], grey[(i + 1) % 2], points, 0.5, 300000, 25, lines);
+            ++i;
+        };
+    } });
+
+    benchmarks.push_back({ "reduce_shadows", [](const cv::Size& sz) -> kernel_t {
+        cv::UMat src = make_frame(sz, CV_8UC3);
+        cv::UMat dst;
+        return [=](FrameArena& arena) mutable {
+            kb::viz2d::reduce_shadows(arena, src, dst, 5);
+        };
+    } });
+
+    benchmarks.push_back({ "unsharp_mask", [](const cv::Size& sz) -> kernel_t {
+        cv::UMat src = make_frame(sz, CV_8UC3);
+        cv::UMat dst;
+        return [=](FrameArena& arena) mutable {
+            kb::viz2d::unsharp_mask(arena, src, dst, 0.8);
+        };
+    } });
+
+    //overlapping detections spread over the frame, about as many as the pedestrian demo sees
+    benchmarks.push_back({ "non_maximal_suppression", [](const cv::Size& sz) -> kernel_t {
+        cv::RNG rng(SEED);
+        vector<vector<double>> boxes;
+        vector<double> probs;
+        for (int i = 0; i < 256; ++i) {
+            double w = rng.uniform(sz.width / 32, sz.width / 8);
+            double h = w * 2;
+            double x = rng.uniform(0, sz.width - int(w));
+            double y = rng.uniform(0, std::max(sz.height - int(h), 1));
+            boxes.push_back({ x, y, x + w, y + h });
+            probs.push_back(rng.uniform(0.0, 1.0));
+        }
+        return [=](FrameArena& arena) mutable {
+            vector<vector<double>> b = boxes;
+            vector<double> p = probs;
+            kb::viz2d::non_maximal_suppression(&b, &p, 0.1);
+        };
+    } });
+
+    benchmarks.push_back({ "composite_layers_blur", [](const cv::Size& sz) -> kernel_t {
+        cv::UMat background = make_frame(sz, CV_8UC4);
+        cv::UMat foreground = make_frame(sz, CV_8UC4, cv::Point(8, 8));
+        cv::UMat frameBuffer(sz, CV_8UC4, cv::Scalar::all(0));
+        int ksize = kernel_size(sz);
+        return [=](FrameArena& arena) mutable {
+            kb::viz2d::composite_layers_blur(arena, background, foreground, frameBuffer, frameBuffer, ksize, 2.5);
+        };
+    } });
+
+    return benchmarks;
+}
+
+static Result run(const kernel_t& kernel, bool ocl, size_t warmup, size_t iterations) {
+    kb::viz2d::FrameArena arena;
+    vector<double> samples;
+    samples.reserve(iterations);
+
+    for (size_t i = 0; i < warmup + iterations; ++i) {
+        int64 begin = cv::getTickCount();
+        kernel(arena);
+        //wait for the queue, otherwise we only measure the enqueueing
+        if (ocl)
+            cv::ocl::finish();
+        int64 end = cv::getTickCount();
+        arena.recycle();
+        if (i >= warmup)
+            samples.push_back((end - begin) * 1000.0 / cv::getTickFrequency());
+    }
+
+    Result r;
+    if (samples.empty())
+        return r;
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    r.min_ = samples.front();
+    r.max_ = samples.back();
+    r.median_ = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2.0;
+    r.mean_ = std::accumulate(samples.begin(), samples.end(), 0.0) / n;
+    double var = 0;
+    for (double s : samples)
+        var += (s - r.mean_) * (s - r.mean_);
+    r.stddev_ = std::sqrt(var / n);
+    return r;
+}
+
+static void print_usage(const char* name) {
+    cerr << "Usage: " << name << " [-o <csv-file>] [-w <warmup>] [-i <iterations>] [-k <kernel>] [--cpu-only]" << endl;
+    cerr << "Writes the results as csv to stdout or <csv-file>." << endl;
+}
+
+int main(int argc, char **argv) {
+    string output;
+    string only;
+    size_t warmup = WARMUP;
+    size_t iterations = ITERATIONS;
+    bool cpuOnly = false;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) {
+            output = argv[++i];
+        } else if ((arg == "-w" || arg == "-i") && i + 1 < argc) {
+            size_t n;
+            try {
+                n = std::stoul(argv[++i]);
+            } catch (std::exception& ex) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            if (arg == "-w")
+                warmup = n;
+            else
+                iterations = std::max(n, size_t(1));
+        } else if (arg == "-k" && i + 1 < argc) {
+            only = argv[++i];
+        } else if (arg == "--cpu-only") {
+            cpuOnly = true;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::ofstream ofs;
+    if (!output.empty()) {
+        ofs.open(output);
+        if (!ofs) {
+            cerr << "Can't open: " << output << endl;
+            return 1;
+        }
+    }
+    std::ostream& csv = output.empty() ? std::cout : ofs;
+
+    vector<bool> oclModes = { false };
+    if (!cpuOnly && cv::ocl::haveOpenCL())
+        oclModes.push_back(true);
+
+    std::vector<cv::Size> sizes = { cv::Size(1280, 720), cv::Size(1920, 1080), cv::Size(3840, 2160) };
+    csv << "kernel,width,height,ocl,device,iterations,mean_ms,median_ms,min_ms,max_ms,stddev_ms" << endl;
+
+    for (bool ocl : oclModes) {
+        cv::ocl::setUseOpenCL(ocl);
+        string device = ocl ? cv::ocl::Device::getDefault().name() : "cpu";
+        //device names may contain commas
+        std::replace(device.begin(), device.end(), ',', ' ');
+
+        for (const auto& b : make_benchmarks()) {
+            if (!only.empty() && b.name_ != only)
+                continue;
+            for (const auto& sz : sizes) {
+                Result r = run(b.setup_(sz), ocl, warmup, iterations);
+                csv << b.name_ << "," << sz.width << "," << sz.height << "," << ocl << "," << device << "," << iterations << "," << r.mean_ << "," << r.median_ << "," << r.min_ << "," << r.max_ << "," << r.stddev_ << endl;
+                cerr << b.name_ << " " << sz << (ocl ? " ocl" : " cpu") << ": " << r.median_ << " ms median, " << r.mean_ << " ms mean, " << r.stddev_ << " ms stddev" << endl;
+            }
+        }
+    }
+
+    return 0;
+}
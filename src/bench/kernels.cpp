@@ -0,0 +1,53 @@
+#include "kernels.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+namespace bench {
+
+void glow_effect(kb::viz2d::FrameArena& arena, const cv::UMat &src, cv::UMat &dst, const int ksize) {
+    cv::UMat resize = arena.get(cv::Size(src.cols / 2, src.rows / 2), src.type());
+    cv::UMat blur = arena.get(src.size(), src.type());
+    cv::UMat dst16 = arena.get(src.size(), CV_MAKETYPE(CV_16U, src.channels()));
+
+    cv::bitwise_not(src, dst);
+
+    //Resize for some extra performance
+    cv::resize(dst, resize, resize.size());
+    //Cheap blur
+    cv::boxFilter(resize, resize, -1, cv::Size(ksize, ksize), cv::Point(-1,-1), true, cv::BORDER_REPLICATE);
+    //Back to original size
+    cv::resize(resize, blur, src.size());
+
+    //Multiply the src image with a blurred version of itself
+    cv::multiply(dst, blur, dst16, 1, CV_16U);
+    //Normalize and convert back to CV_8U
+    cv::divide(dst16, cv::Scalar::all(255.0), dst, 1, CV_8U);
+
+    cv::bitwise_not(dst, dst);
+}
+
+void bloom(kb::viz2d::FrameArena& arena, const cv::UMat& src, cv::UMat &dst, int ksize, int threshValue, float gain) {
+    cv::UMat bgr = arena.get(src.size(), CV_8UC3);
+    cv::UMat hls = arena.get(src.size(), CV_8UC3);
+    cv::UMat ls16 = arena.get(src.size(), CV_16UC1);
+    cv::UMat ls = arena.get(src.size(), CV_8UC1);
+    cv::UMat blur = arena.get(src.size(), CV_8UC1);
+    cv::UMat blurBGRA = arena.get(src.size(), CV_8UC4);
+    std::vector<cv::UMat> hlsChannels = { arena.get(src.size(), CV_8UC1), arena.get(src.size(), CV_8UC1), arena.get(src.size(), CV_8UC1) };
+
+    cv::cvtColor(src, bgr, cv::COLOR_BGRA2RGB);
+    cv::cvtColor(bgr, hls, cv::COLOR_BGR2HLS);
+    cv::split(hls, hlsChannels);
+    cv::bitwise_not(hlsChannels[2], hlsChannels[2]);
+
+    cv::multiply(hlsChannels[1], hlsChannels[2], ls16, 1, CV_16U);
+    cv::divide(ls16, cv::Scalar(255.0), ls, 1, CV_8U);
+    cv::threshold(ls, blur, threshValue, 255, cv::THRESH_BINARY);
+
+    cv::boxFilter(blur, blur, -1, cv::Size(ksize, ksize), cv::Point(-1,-1), true, cv::BORDER_REPLICATE);
+    cv::cvtColor(blur, blurBGRA, cv::COLOR_GRAY2BGRA);
+
+    addWeighted(src, 1.0, blurBGRA, gain, 0, dst);
+}
+
+}
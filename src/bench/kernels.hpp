@@ -0,0 +1,20 @@
+#ifndef SRC_BENCH_KERNELS_HPP_
+#define SRC_BENCH_KERNELS_HPP_
+
+#include <opencv2/core.hpp>
+#include "../common/framearena.hpp"
+
+/*
+ * The unfused chains glow_effect and bloom_effect of libviz2d replaced. Kept as the references the fused versions are
+ * checked and timed against. Everything else the bench measures is called from libviz2d directly.
+ */
+namespace bench {
+
+//the chain the optflow, quad and video demo used before kb::viz2d::glow_effect. the reference for the fused version.
+void glow_effect(kb::viz2d::FrameArena& arena, const cv::UMat &src, cv::UMat &dst, const int ksize);
+
+//the chain the optflow demo used before kb::viz2d::bloom_effect. the reference for the fused version.
+void bloom(kb::viz2d::FrameArena& arena, const cv::UMat& src, cv::UMat &dst, int ksize = 3, int threshValue = 235, float gain = 4);
+}
+
+#endif /* SRC_BENCH_KERNELS_HPP_ */
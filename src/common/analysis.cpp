@@ -0,0 +1,194 @@
+#include "analysis.hpp"
+#include "functionpool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/video.hpp>
+#include <opencv2/features2d.hpp>
+
+namespace kb {
+namespace viz2d {
+
+MotionDetector::MotionDetector() :
+        subtractor_(cv::createBackgroundSubtractorMOG2(100, 16.0, false)) {
+    int morphSize = 1;
+    element_ = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2 * morphSize + 1, 2 * morphSize + 1), cv::Point(morphSize, morphSize));
+}
+
+void MotionDetector::mask(const cv::UMat& srcGrey, cv::UMat& motionMaskGrey) {
+    subtractor_->apply(srcGrey, motionMaskGrey);
+    cv::morphologyEx(motionMaskGrey, motionMaskGrey, cv::MORPH_OPEN, element_, cv::Point(element_.cols >> 1, element_.rows >> 1), 2, cv::BORDER_CONSTANT, cv::morphologyDefaultBorderValue());
+}
+
+bool MotionDetector::detectSceneChange(const cv::UMat& motionMaskGrey, float thresh, float threshDiff) {
+    float movement = cv::countNonZero(motionMaskGrey) / double(motionMaskGrey.cols * motionMaskGrey.rows);
+    float relation = movement > 0 && lastMovement_ > 0 ? std::max(movement, lastMovement_) / std::min(movement, lastMovement_) : 0;
+    float relM = relation * log10(1.0f + (movement * 9.0));
+    float relLM = relation * log10(1.0f + (lastMovement_ * 9.0));
+
+    bool result = !((movement > 0 && lastMovement_ > 0 && relation > 0)
+            && (relM < thresh && relLM < thresh && fabs(relM - relLM) < threshDiff));
+    lastMovement_ = (lastMovement_ + movement) / 2.0f;
+    return result;
+}
+
+void detect_points(const cv::Mat& srcMotionMaskGrey, std::vector<cv::Point2f>& points) {
+    //the detector has no state between calls, one per thread is enough
+    static thread_local cv::Ptr<cv::FastFeatureDetector> detector = cv::FastFeatureDetector::create(1, false);
+    static thread_local std::vector<cv::KeyPoint> tmpKeyPoints;
+
+    tmpKeyPoints.clear();
+    detector->detect(srcMotionMaskGrey, tmpKeyPoints);
+
+    points.clear();
+    for (const auto &kp : tmpKeyPoints) {
+        points.push_back(kp.pt);
+    }
+}
+
+SparseOpticalFlow::SparseOpticalFlow(unsigned int seed) : rng_(seed) {
+}
+
+void SparseOpticalFlow::track(const cv::UMat& prevGrey, const cv::UMat& nextGrey, const std::vector<cv::Point2f>& detectedPoints, float scaleFactor, int maxPoints, float pointLossPercent, std::vector<cv::Vec4f>& lines) {
+    lines.clear();
+    area_ = 0;
+    if (detectedPoints.size() <= 4)
+        return;
+
+    cv::convexHull(detectedPoints, hull_);
+    area_ = cv::contourArea(hull_);
+    if (area_ <= 0)
+        return;
+
+    float density = (detectedPoints.size() / area_);
+    size_t currentMaxPoints = ceil(density * maxPoints);
+
+    std::shuffle(prevPoints_.begin(), prevPoints_.end(), rng_);
+    prevPoints_.resize(ceil(prevPoints_.size() * (1.0f - (pointLossPercent / 100.0f))));
+
+    size_t copyn = std::min(detectedPoints.size(), (size_t(std::ceil(currentMaxPoints)) - prevPoints_.size()));
+    if (prevPoints_.size() < currentMaxPoints) {
+        std::copy(detectedPoints.begin(), detectedPoints.begin() + copyn, std::back_inserter(prevPoints_));
+    }
+
+    cv::calcOpticalFlowPyrLK(prevGrey, nextGrey, prevPoints_, nextPoints_, status_, err_);
+    newPoints_.clear();
+    if (prevPoints_.size() > 1 && nextPoints_.size() > 1) {
+        upNextPoints_.clear();
+        upPrevPoints_.clear();
+        for (cv::Point2f pt : prevPoints_) {
+            upPrevPoints_.push_back(pt /= scaleFactor);
+        }
+
+        for (cv::Point2f pt : nextPoints_) {
+            upNextPoints_.push_back(pt /= scaleFactor);
+        }
+
+        //filter the points in parallel
+        keep_.assign(prevPoints_.size(), 0);
+        float maxLen = sqrt(area_);
+        pool().parallelFor(0, prevPoints_.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                if (status_[i] == 1 && err_[i] < (1.0 / density) && upNextPoints_[i].y >= 0 && upNextPoints_[i].x >= 0 && upNextPoints_[i].y < nextGrey.rows / scaleFactor && upNextPoints_[i].x < nextGrey.cols / scaleFactor) {
+                    float len = hypot(fabs(upPrevPoints_[i].x - upNextPoints_[i].x), fabs(upPrevPoints_[i].y - upNextPoints_[i].y));
+                    keep_[i] = len > 0 && len < maxLen;
+                }
+            }
+        });
+
+        for (size_t i = 0; i < prevPoints_.size(); i++) {
+            if (keep_[i]) {
+                newPoints_.push_back(nextPoints_[i]);
+                lines.push_back(cv::Vec4f(upNextPoints_[i].x, upNextPoints_[i].y, upPrevPoints_[i].x, upPrevPoints_[i].y));
+            }
+        }
+    }
+    prevPoints_ = newPoints_;
+}
+
+float SparseOpticalFlow::getHullArea() {
+    return area_;
+}
+
+static inline bool pair_comparator(std::pair<double, size_t> l1, std::pair<double, size_t> l2) {
+    return l1.first > l2.first;
+}
+
+//adapted from cv::dnn_objdetect::InferBbox
+static void intersection_over_union(std::vector<std::vector<double> > *boxes, std::vector<double> *base_box, std::vector<double> *iou) {
+    double g_xmin = (*base_box)[0];
+    double g_ymin = (*base_box)[1];
+    double g_xmax = (*base_box)[2];
+    double g_ymax = (*base_box)[3];
+    double base_box_w = g_xmax - g_xmin;
+    double base_box_h = g_ymax - g_ymin;
+    for (size_t b = 0; b < (*boxes).size(); ++b) {
+        double xmin = std::max((*boxes)[b][0], g_xmin);
+        double ymin = std::max((*boxes)[b][1], g_ymin);
+        double xmax = std::min((*boxes)[b][2], g_xmax);
+        double ymax = std::min((*boxes)[b][3], g_ymax);
+
+        // Intersection
+        double w = std::max(static_cast<double>(0.0), xmax - xmin);
+        double h = std::max(static_cast<double>(0.0), ymax - ymin);
+        // Union
+        double test_box_w = (*boxes)[b][2] - (*boxes)[b][0];
+        double test_box_h = (*boxes)[b][3] - (*boxes)[b][1];
+
+        double inter_ = w * h;
+        double union_ = test_box_h * test_box_w + base_box_h * base_box_w - inter_;
+        (*iou)[b] = inter_ / (union_ + 1e-7);
+    }
+}
+
+std::vector<bool> non_maximal_suppression(std::vector<std::vector<double> > *boxes, std::vector<double> *probs, const double threshold) {
+    std::vector<bool> keep(((*probs).size()));
+    std::fill(keep.begin(), keep.end(), true);
+    std::vector<size_t> prob_args_sorted((*probs).size());
+
+    std::vector<std::pair<double, size_t> > temp_sort((*probs).size());
+    for (size_t tidx = 0; tidx < (*probs).size(); ++tidx) {
+        temp_sort[tidx] = std::make_pair((*probs)[tidx], static_cast<size_t>(tidx));
+    }
+    std::sort(temp_sort.begin(), temp_sort.end(), pair_comparator);
+
+    for (size_t idx = 0; idx < temp_sort.size(); ++idx) {
+        prob_args_sorted[idx] = temp_sort[idx].second;
+    }
+
+    if (prob_args_sorted.empty())
+        return keep;
+
+    //every box suppresses the lower scored boxes it overlaps with. that is independent per box, so spread it over the pool.
+    std::vector<std::atomic<bool>> suppressed(prob_args_sorted.size());
+    pool().parallelFor(0, prob_args_sorted.size() - 1, [&](size_t begin, size_t end) {
+        for (size_t idx = begin; idx < end; ++idx) {
+            std::vector<double> iou_(prob_args_sorted.size() - idx - 1);
+            std::vector<std::vector<double> > temp_boxes(iou_.size());
+            for (size_t bb = 0; bb < temp_boxes.size(); ++bb) {
+                std::vector<double> temp_box(4);
+                for (size_t b = 0; b < 4; ++b) {
+                    temp_box[b] = (*boxes)[prob_args_sorted[idx + bb + 1]][b];
+                }
+                temp_boxes[bb] = temp_box;
+            }
+            intersection_over_union(&temp_boxes, &(*boxes)[prob_args_sorted[idx]], &iou_);
+            for (std::vector<double>::iterator _itr = iou_.begin(); _itr != iou_.end(); ++_itr) {
+                size_t iou_idx = _itr - iou_.begin();
+                if (*_itr > threshold) {
+                    suppressed[prob_args_sorted[idx + iou_idx + 1]].store(true, std::memory_order_relaxed);
+                }
+            }
+        }
+    });
+
+    for (size_t i = 0; i < suppressed.size(); ++i) {
+        if (suppressed[i])
+            keep[i] = false;
+    }
+    return keep;
+}
+} /* namespace viz2d */
+} /* namespace kb */
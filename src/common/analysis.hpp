@@ -0,0 +1,56 @@
+#ifndef SRC_COMMON_ANALYSIS_HPP_
+#define SRC_COMMON_ANALYSIS_HPP_
+
+#include <random>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/video/background_segm.hpp>
+
+namespace kb {
+namespace viz2d {
+
+/*!
+ * Mask of moving objects and scene change detection on that mask. Keeps the background model and the amount of
+ * movement between frames, so use one instance per video.
+ */
+class MotionDetector {
+    cv::Ptr<cv::BackgroundSubtractor> subtractor_;
+    cv::Mat element_;
+    float lastMovement_ = 0;
+public:
+    MotionDetector();
+    //subtracts the background model from srcGrey and removes the noise
+    void mask(const cv::UMat& srcGrey, cv::UMat& motionMaskGrey);
+    //true if the amount of movement in motionMaskGrey doesn't relate to the one of the previous frames
+    bool detectSceneChange(const cv::UMat& motionMaskGrey, float thresh, float threshDiff);
+};
+
+//FAST corners of a motion mask
+void detect_points(const cv::Mat& srcMotionMaskGrey, std::vector<cv::Point2f>& points);
+
+/*!
+ * Tracks points from frame to frame with Lucas-Kanade. Every frame a share of the tracked points is dropped and
+ * replaced by newly detected ones, scaled by the density of the detected points.
+ */
+class SparseOpticalFlow {
+    std::vector<cv::Point2f> hull_, prevPoints_, nextPoints_, newPoints_;
+    std::vector<cv::Point2f> upPrevPoints_, upNextPoints_;
+    std::vector<uchar> status_;
+    std::vector<uchar> keep_;
+    std::vector<float> err_;
+    std::mt19937 rng_;
+    float area_ = 0;
+public:
+    SparseOpticalFlow(unsigned int seed = std::random_device()());
+    //lines receives (next x, next y, prev x, prev y) of every point that moved plausibly, divided by scaleFactor
+    void track(const cv::UMat& prevGrey, const cv::UMat& nextGrey, const std::vector<cv::Point2f>& detectedPoints, float scaleFactor, int maxPoints, float pointLossPercent, std::vector<cv::Vec4f>& lines);
+    //area of the convex hull of the detected points of the last call
+    float getHullArea();
+};
+
+//adapted from cv::dnn_objdetect::InferBbox. boxes are (xmin, ymin, xmax, ymax).
+std::vector<bool> non_maximal_suppression(std::vector<std::vector<double> > *boxes, std::vector<double> *probs, const double threshold = 0.1);
+} /* namespace viz2d */
+} /* namespace kb */
+
+#endif /* SRC_COMMON_ANALYSIS_HPP_ */
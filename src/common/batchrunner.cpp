@@ -0,0 +1,105 @@
+#include "batchrunner.hpp"
+#include "viz2d.hpp"
+#include "functionpool.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <opencv2/core/ocl.hpp>
+
+namespace kb {
+namespace viz2d {
+
+static double seconds_between(std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+    return std::chrono::duration<double>(b - a).count();
+}
+
+BatchRunner::BatchRunner(const cv::Size& frameBufferSize, setup_t setup, size_t concurrency) :
+        frameBufferSize_(frameBufferSize), setup_(setup), concurrency_(concurrency) {
+}
+
+BatchJob& BatchRunner::add(const std::string& input, const std::string& output) {
+    auto& job = jobs_.emplace_back(new BatchJob());
+    job->input_ = input;
+    job->output_ = output;
+    return *job;
+}
+
+void BatchRunner::runJob(BatchJob& job) {
+    job.start_ = std::chrono::steady_clock::now();
+    job.state_.store(BatchJob::RUNNING, std::memory_order_release);
+    //pool workers have OpenCL disabled
+    cv::ocl::setUseOpenCL(true);
+    try {
+        cv::Ptr<Viz2D> v2d = new Viz2D(frameBufferSize_, frameBufferSize_, true, job.input_, 4, 6, 0, false, true);
+        auto frame = setup_(v2d, job);
+        while (frame())
+            ++job.frames_;
+        //make sure the last frames are encoded before the job counts as done
+        v2d->flush();
+        job.end_ = std::chrono::steady_clock::now();
+        job.state_.store(BatchJob::DONE, std::memory_order_release);
+    } catch (std::exception& ex) {
+        cerr << job.input_ << ": " << ex.what() << endl;
+        job.end_ = std::chrono::steady_clock::now();
+        job.state_.store(BatchJob::FAILED, std::memory_order_release);
+    }
+    cv::ocl::setUseOpenCL(false);
+}
+
+void BatchRunner::report(std::ostream& os, double seconds) {
+    static const char* states[] = { "pending", "running", "done", "failed" };
+    auto now = std::chrono::steady_clock::now();
+    size_t frames = 0;
+
+    os << std::fixed << std::setprecision(1);
+    for (size_t i = 0; i < jobs_.size(); ++i) {
+        BatchJob& job = *jobs_[i];
+        //start_ and end_ are only read after the state that published them
+        BatchJob::State state = job.state_.load(std::memory_order_acquire);
+        size_t done = job.frames_;
+        size_t total = job.totalFrames_;
+        frames += done;
+
+        os << "[" << (i + 1) << "/" << jobs_.size() << "] " << job.input_ << ": " << states[state] << " " << done;
+        if (total > 0)
+            os << "/" << total << " (" << (100.0 * done / total) << "%)";
+        os << " frames";
+        if (state != BatchJob::PENDING) {
+            double elapsed = seconds_between(job.start_, state == BatchJob::RUNNING ? now : job.end_);
+            if (elapsed > 0)
+                os << ", " << (done / elapsed) << " fps";
+        }
+        os << endl;
+    }
+    os << "total: " << frames << " frames in " << seconds << "s, " << (seconds > 0 ? frames / seconds : 0) << " fps" << endl;
+}
+
+size_t BatchRunner::run(std::ostream& os, double interval) {
+    if (jobs_.empty())
+        return 0;
+
+    size_t n = concurrency_ == 0 ? std::max(std::thread::hardware_concurrency(), 1u) : concurrency_;
+    //dedicated workers, so jobs don't block the CPU stages of the shared pool
+    detail::FunctionPool runners(std::min(n, jobs_.size()));
+    std::vector<std::future<void>> futures;
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto& job : jobs_) {
+        BatchJob* j = job.get();
+        futures.push_back(runners.push([this, j]() {
+            runJob(*j);
+        }));
+    }
+
+    for (auto& f : futures) {
+        while (f.wait_for(std::chrono::duration<double>(interval)) != std::future_status::ready)
+            report(os, seconds_between(start, std::chrono::steady_clock::now()));
+    }
+    report(os, seconds_between(start, std::chrono::steady_clock::now()));
+
+    return std::count_if(jobs_.begin(), jobs_.end(), [](const std::unique_ptr<BatchJob>& j) {
+        return j->state_ == BatchJob::FAILED;
+    });
+}
+} /* namespace viz2d */
+} /* namespace kb */
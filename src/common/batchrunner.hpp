@@ -0,0 +1,64 @@
+#ifndef SRC_COMMON_BATCHRUNNER_HPP_
+#define SRC_COMMON_BATCHRUNNER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+
+namespace kb {
+namespace viz2d {
+class Viz2D;
+
+struct BatchJob {
+    enum State {
+        PENDING,
+        RUNNING,
+        DONE,
+        FAILED
+    };
+
+    std::string input_;
+    std::string output_;
+    //0 if unknown. may be set by the setup function.
+    std::atomic<size_t> totalFrames_ = 0;
+    std::atomic<size_t> frames_ = 0;
+    //published with release ordering. start_ and end_ are written before the state changes.
+    std::atomic<State> state_ = PENDING;
+    //valid once an acquire load of state_ saw the job running respectively done
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::time_point end_;
+};
+
+/*!
+ * Runs many pipelines concurrently in one process. Every job gets its own headless Viz2D on a dedicated worker, so
+ * the GL and CL contexts never move between threads. Jobs that use the shared BufferStore (buf(), var()) need an
+ * instance index of their own.
+ */
+class BatchRunner {
+public:
+    //sets up the pipeline of a job and returns the function that processes one frame. it returns false at the end of the input.
+    typedef std::function<std::function<bool()>(cv::Ptr<Viz2D>, BatchJob&)> setup_t;
+private:
+    cv::Size frameBufferSize_;
+    setup_t setup_;
+    size_t concurrency_;
+    std::vector<std::unique_ptr<BatchJob>> jobs_;
+
+    void runJob(BatchJob& job);
+    void report(std::ostream& os, double seconds);
+public:
+    //concurrency == 0 means one job per hardware thread
+    BatchRunner(const cv::Size& frameBufferSize, setup_t setup, size_t concurrency = 0);
+    BatchJob& add(const std::string& input, const std::string& output);
+    //runs all jobs, reports progress and throughput to os every interval seconds and returns the number of failed jobs
+    size_t run(std::ostream& os = std::cerr, double interval = 1.0);
+};
+} /* namespace viz2d */
+} /* namespace kb */
+
+#endif /* SRC_COMMON_BATCHRUNNER_HPP_ */
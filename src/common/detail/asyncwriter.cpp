@@ -0,0 +1,121 @@
+#include "asyncwriter.hpp"
+
+#include <iostream>
+
+namespace kb {
+namespace viz2d {
+namespace detail {
+
+AsyncWriter::AsyncWriter(size_t depth, bool dropWhenFull) :
+        ring_(std::max(depth, size_t(1))), dropWhenFull_(dropWhenFull) {
+    thread_ = std::thread([this]() {
+        run();
+    });
+}
+
+AsyncWriter::~AsyncWriter() {
+    flush();
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        running_ = false;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+void AsyncWriter::run() {
+    while (true) {
+        Job* job;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            cond_.wait(lock, [this]() {
+                return queued_ > 0 || !running_;
+            });
+            if (queued_ == 0 && !running_)
+                return;
+            job = &ring_[head_];
+        }
+
+        //the slot stays queued while it is being encoded so the producer can't overwrite it.
+#ifndef __EMSCRIPTEN__
+        if (job->copied_) {
+            clWaitForEvents(1, &job->copied_);
+            clReleaseEvent(job->copied_);
+            job->copied_ = nullptr;
+        }
+#endif
+        try {
+            job->fn_(job->frame_);
+        } catch (std::exception& ex) {
+            std::cerr << "Encoding failed: " << ex.what() << std::endl;
+        }
+        job->fn_ = nullptr;
+
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            head_ = (head_ + 1) % ring_.size();
+            --queued_;
+        }
+        cond_.notify_all();
+    }
+}
+
+bool AsyncWriter::push(const cv::UMat& frame, std::function<void(const cv::UMat&)> fn) {
+    size_t slot;
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        if (queued_ == ring_.size() && dropWhenFull_) {
+            ++dropped_;
+            return false;
+        }
+
+        cond_.wait(lock, [this]() {
+            return queued_ < ring_.size();
+        });
+        slot = (head_ + queued_) % ring_.size();
+    }
+
+    //the slot isn't visible to the encoder until it is queued, so we may copy without holding the lock
+    Job& job = ring_[slot];
+    frame.copyTo(job.frame_);
+#ifndef __EMSCRIPTEN__
+    //the copy has to be complete before another thread (and queue) picks it up. the encoder thread waits for a marker
+    //behind the copy instead of us draining the whole queue.
+    if (cv::ocl::useOpenCL()) {
+        cl_command_queue queue = static_cast<cl_command_queue>(cv::ocl::Queue::getDefault().ptr());
+        if (clEnqueueMarkerWithWaitList(queue, 0, nullptr, &job.copied_) == CL_SUCCESS) {
+            clFlush(queue);
+        } else {
+            job.copied_ = nullptr;
+            cv::ocl::finish();
+        }
+    }
+#endif
+    job.fn_ = fn;
+
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        ++queued_;
+    }
+    cond_.notify_all();
+    return true;
+}
+
+void AsyncWriter::flush() {
+    std::unique_lock<std::mutex> lock(mtx_);
+    cond_.wait(lock, [this]() {
+        return queued_ == 0;
+    });
+}
+
+size_t AsyncWriter::getDepth() {
+    return ring_.size();
+}
+
+size_t AsyncWriter::getDropped() {
+    std::unique_lock<std::mutex> lock(mtx_);
+    return dropped_;
+}
+}
+}
+}
@@ -0,0 +1,51 @@
+#ifndef SRC_COMMON_ASYNCWRITER_HPP_
+#define SRC_COMMON_ASYNCWRITER_HPP_
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include "clglcontext.hpp"
+
+namespace kb {
+namespace viz2d {
+namespace detail {
+
+/*!
+ * Snapshots frames into a bounded ring of pooled UMats and hands them to a dedicated encoder thread.
+ * When the ring is full push() either blocks until a slot is free or drops the frame.
+ */
+class AsyncWriter {
+    struct Job {
+        cv::UMat frame_;
+        std::function<void(const cv::UMat&)> fn_;
+#ifndef __EMSCRIPTEN__
+        //completes when the copy into frame_ is done
+        cl_event copied_ = nullptr;
+#endif
+    };
+    std::vector<Job> ring_;
+    size_t head_ = 0;
+    size_t queued_ = 0;
+    size_t dropped_ = 0;
+    bool dropWhenFull_;
+    bool running_ = true;
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    std::thread thread_;
+    void run();
+public:
+    AsyncWriter(size_t depth, bool dropWhenFull);
+    virtual ~AsyncWriter();
+    bool push(const cv::UMat& frame, std::function<void(const cv::UMat&)> fn);
+    void flush();
+    size_t getDepth();
+    size_t getDropped();
+};
+}
+}
+}
+
+#endif /* SRC_COMMON_ASYNCWRITER_HPP_ */
@@ -0,0 +1,80 @@
+#include "bufferstore.hpp"
+#include "../framearena.hpp"
+
+namespace kb {
+namespace viz2d {
+namespace detail {
+
+BufferHandle BufferStore::resolve(const size_t& i, const std::string& name) {
+    std::lock_guard<std::recursive_mutex> lock(mtx_);
+    auto key = std::make_pair(i, name);
+    auto it = index_.find(key);
+    if (it != index_.end())
+        return BufferHandle { it->second };
+
+    BufferHandle h { entries_.size() };
+    entries_.push_back(Entry { i, name, cv::UMat(), nullptr, BufferStats() });
+    index_[key] = h.index_;
+    return h;
+}
+
+void BufferStore::drop(Entry& e) {
+    if (e.arena_)
+        e.arena_->release(e.buf_);
+    e.arena_ = nullptr;
+    e.buf_.release();
+}
+
+BufferHandle BufferStore::allocate(const size_t& i, const std::string& name, const cv::Size& sz, int type, const cv::Scalar& defaultValue, cv::UMatUsageFlags usageFlags) {
+    std::lock_guard<std::recursive_mutex> lock(mtx_);
+    BufferHandle h = resolve(i, name);
+    Entry& e = entries_[h.index_];
+
+    if (e.arena_ || e.buf_.size() != sz || e.buf_.type() != type || e.buf_.usageFlags != usageFlags) {
+        drop(e);
+        e.buf_.create(sz, type, usageFlags);
+        ++e.stats_.allocations_;
+        e.stats_.bytes_ = e.buf_.total() * e.buf_.elemSize();
+    }
+
+    e.buf_.setTo(defaultValue);
+    return h;
+}
+
+cv::UMat& BufferStore::acquire(const BufferHandle& h, FrameArena& arena, const cv::Size& sz, int type) {
+    std::lock_guard<std::recursive_mutex> lock(mtx_);
+    Entry& e = entries_[h.index_];
+    drop(e);
+    e.buf_ = arena.get(sz, type);
+    e.arena_ = &arena;
+    ++e.stats_.acquires_;
+    e.stats_.bytes_ = e.buf_.total() * e.buf_.elemSize();
+    return e.buf_;
+}
+
+void BufferStore::release(const BufferHandle& h) {
+    std::lock_guard<std::recursive_mutex> lock(mtx_);
+    Entry& e = entries_[h.index_];
+    drop(e);
+    ++e.stats_.releases_;
+}
+
+const BufferStats& BufferStore::getStats(const BufferHandle& h) {
+    std::lock_guard<std::recursive_mutex> lock(mtx_);
+    return entries_[h.index_].stats_;
+}
+
+void BufferStore::printStats(std::ostream& os) {
+    std::lock_guard<std::recursive_mutex> lock(mtx_);
+    for (const auto& e : entries_) {
+        os << e.instance_ << "/" << e.name_ << ": " << e.stats_.bytes_ << " bytes, " << e.stats_.allocations_ << " allocations, " << e.stats_.acquires_ << " acquires, " << e.stats_.releases_ << " releases, " << e.stats_.accesses_ << " accesses" << std::endl;
+    }
+}
+
+BufferStore& store() {
+    static BufferStore instance;
+    return instance;
+}
+}
+}
+}
@@ -0,0 +1,100 @@
+#ifndef SRC_COMMON_BUFFERSTORE_HPP_
+#define SRC_COMMON_BUFFERSTORE_HPP_
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <ostream>
+#include <opencv2/core.hpp>
+
+namespace kb {
+namespace viz2d {
+class FrameArena;
+namespace detail {
+
+//an interned buffer name. resolve it once and use it for O(1) access.
+struct BufferHandle {
+    size_t index_ = size_t(-1);
+
+    bool valid() const {
+        return index_ != size_t(-1);
+    }
+};
+
+struct BufferStats {
+    //buffers that had to be created by allocate()
+    size_t allocations_ = 0;
+    //buffers that were taken from a frame arena
+    size_t acquires_ = 0;
+    size_t releases_ = 0;
+    size_t accesses_ = 0;
+    size_t bytes_ = 0;
+};
+
+/*!
+ * Named buffers and variables per instance index. Names are resolved to handles once. A buffer either lives until it is
+ * released (allocate()) or is taken from a FrameArena for the current frame (acquire()). Releasing an acquired buffer
+ * hands it back to the arena right away, so a later stage of the same frame reuses it without a driver allocation.
+ * References returned by buf() stay valid for the lifetime of the store.
+ */
+class BufferStore {
+    struct Entry {
+        size_t instance_;
+        std::string name_;
+        cv::UMat buf_;
+        //the arena buf_ was acquired from, if any
+        FrameArena* arena_ = nullptr;
+        BufferStats stats_;
+    };
+
+    //a deque, so references to the buffers survive new entries
+    std::deque<Entry> entries_;
+    std::map<std::pair<size_t, std::string>, size_t> index_;
+    std::map<size_t, std::map<std::string, void*>> varMap_;
+    std::recursive_mutex mtx_;
+
+    void drop(Entry& e);
+public:
+    BufferHandle resolve(const size_t& i, const std::string& name);
+    BufferHandle allocate(const size_t& i, const std::string& name, const cv::Size& sz, int type, const cv::Scalar& defaultValue, cv::UMatUsageFlags usageFlags = cv::USAGE_DEFAULT);
+    //takes the buffer from arena until it is released or the frame ends. the content is undefined.
+    cv::UMat& acquire(const BufferHandle& h, FrameArena& arena, const cv::Size& sz, int type);
+    //frees the buffer or hands it back to its arena. the handle stays valid.
+    void release(const BufferHandle& h);
+
+    cv::UMat& buf(const BufferHandle& h) {
+        std::lock_guard<std::recursive_mutex> lock(mtx_);
+        Entry& e = entries_[h.index_];
+        ++e.stats_.accesses_;
+        return e.buf_;
+    }
+
+    cv::UMat& buf(const size_t& i, const std::string& name) {
+        return buf(resolve(i, name));
+    }
+
+    const BufferStats& getStats(const BufferHandle& h);
+    void printStats(std::ostream& os);
+
+    template <typename T> T& var(const size_t& i, const std::string& name) {
+        std::lock_guard<std::recursive_mutex> lock(mtx_);
+        auto& varMap = varMap_[i];
+        auto it = varMap.find(name);
+        if(it != varMap.end()) {
+            return *static_cast<T*>((*it).second);
+        } else {
+            auto* p = new T();
+            varMap[name] = p;
+            return *p;
+        }
+    }
+};
+
+//the store shared by all translation units
+BufferStore& store();
+}
+}
+}
+
+#endif /* SRC_COMMON_BUFFERSTORE_HPP_ */
@@ -0,0 +1,88 @@
+#include "captureprefetcher.hpp"
+
+namespace kb {
+namespace viz2d {
+namespace detail {
+
+CapturePrefetcher::CapturePrefetcher(std::function<bool(cv::UMat&)> source, size_t depth, CLExecContext_t context) :
+        source_(source), ring_(std::max(depth, size_t(1)))
+#ifndef __EMSCRIPTEN__
+        , context_(context)
+#endif
+{
+    thread_ = std::thread([this]() {
+        run();
+    });
+}
+
+CapturePrefetcher::~CapturePrefetcher() {
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        running_ = false;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+void CapturePrefetcher::run() {
+#ifndef __EMSCRIPTEN__
+    //the decoder needs the same execution context as the synchronous capture path, e.g. for VAAPI interop
+    std::optional<CLExecScope_t> scope;
+    if (!context_.empty())
+        scope.emplace(context_);
+#endif
+    while (true) {
+        size_t slot;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            cond_.wait(lock, [this]() {
+                return ready_ < ring_.size() || !running_;
+            });
+            if (!running_)
+                return;
+            slot = (head_ + ready_) % ring_.size();
+        }
+
+        //the slot isn't visible to the consumer until it is marked ready, so we may decode without holding the lock
+        bool success = source_(ring_[slot]) && !ring_[slot].empty();
+
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            if (success)
+                ++ready_;
+            else
+                eof_ = true;
+        }
+        cond_.notify_all();
+
+        if (!success)
+            return;
+    }
+}
+
+bool CapturePrefetcher::pop(cv::UMat& frame) {
+    std::unique_lock<std::mutex> lock(mtx_);
+    cond_.wait(lock, [this]() {
+        return ready_ > 0 || eof_;
+    });
+
+    if (ready_ == 0) {
+        frame.release();
+        return false;
+    }
+
+    //hand the consumer's previous frame back to the ring so its memory is reused by the decoder
+    std::swap(frame, ring_[head_]);
+    head_ = (head_ + 1) % ring_.size();
+    --ready_;
+    lock.unlock();
+    cond_.notify_all();
+    return true;
+}
+
+size_t CapturePrefetcher::getDepth() {
+    return ring_.size();
+}
+}
+}
+}
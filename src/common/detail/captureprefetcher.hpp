@@ -0,0 +1,45 @@
+#ifndef SRC_COMMON_CAPTUREPREFETCHER_HPP_
+#define SRC_COMMON_CAPTUREPREFETCHER_HPP_
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <optional>
+
+#include "clglcontext.hpp"
+
+namespace kb {
+namespace viz2d {
+namespace detail {
+
+/*!
+ * Decodes frames on a separate thread into a bounded ring of UMats, so that the consumer only has to pop
+ * the next ready frame. The source function returns false (or an empty frame) at the end of the stream.
+ */
+class CapturePrefetcher {
+    std::function<bool(cv::UMat&)> source_;
+    std::vector<cv::UMat> ring_;
+    size_t head_ = 0;
+    size_t ready_ = 0;
+    bool eof_ = false;
+    bool running_ = true;
+    std::mutex mtx_;
+    std::condition_variable cond_;
+#ifndef __EMSCRIPTEN__
+    CLExecContext_t context_;
+#endif
+    std::thread thread_;
+    void run();
+public:
+    CapturePrefetcher(std::function<bool(cv::UMat&)> source, size_t depth, CLExecContext_t context);
+    virtual ~CapturePrefetcher();
+    bool pop(cv::UMat& frame);
+    size_t getDepth();
+};
+}
+}
+}
+
+#endif /* SRC_COMMON_CAPTUREPREFETCHER_HPP_ */
@@ -7,12 +7,19 @@ namespace viz2d {
 namespace detail {
 
 //FIXME use cv::ogl
-CLGLContext::CLGLContext(const cv::Size& frameBufferSize) :
+CLGLContext::CLGLContext(const cv::Size& frameBufferSize, CLGLContext* shared) :
         frameBufferSize_(frameBufferSize) {
 #ifndef __EMSCRIPTEN__
     glewExperimental = true;
     glewInit();
-    cv::ogl::ocl::initializeContextFromGL();
+    //interop works for all GL objects of the share group, so one OpenCL context is enough
+    if (!shared)
+        cv::ogl::ocl::initializeContextFromGL();
+    //If available we render upside-down and keep the texture top-down like cv::UMat, so no flipping is required.
+    clipControl_ = GLEW_VERSION_4_5 || GLEW_ARB_clip_control;
+    //Use fences instead of glFinish if possible. With cl_khr_gl_event acquiring a GL object implicitly waits for GL.
+    fenceSync_ = GLEW_VERSION_3_2 || GLEW_ARB_sync;
+    implicitSync_ = cv::ocl::Device::getDefault().isExtensionSupported("cl_khr_gl_event");
 #endif
     frameBufferID_ = 0;
     GL_CHECK(glGenFramebuffers(1, &frameBufferID_));
@@ -32,27 +39,49 @@ CLGLContext::CLGLContext(const cv::Size& frameBufferSize) :
     GL_CHECK(glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureID_, 0));
     assert(glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
 #ifndef __EMSCRIPTEN__
-    context_ = CLExecContext_t::getCurrent();
+    //own queue, same context
+    context_ = shared ? shared->getCLExecContext().cloneWithNewQueue() : CLExecContext_t::getCurrent();
 #endif
 }
 
 CLGLContext::~CLGLContext() {
     end();
+    waitForGL();
     glDeleteTextures(1, &textureID_);
     glDeleteRenderbuffers( 1, &renderBufferID_);
     glDeleteFramebuffers( 1, &frameBufferID_);
+    if (readFrameBufferID_)
+        glDeleteFramebuffers(1, &readFrameBufferID_);
 }
 
 cv::Size CLGLContext::getSize() {
     return frameBufferSize_;
 }
 
-void CLGLContext::execute(std::function<void(cv::UMat&)> fn) {
+CLGLContext::FrameBufferState CLGLContext::getState() {
+    return state_;
+}
+
+bool CLGLContext::isFenceSync() {
+    return fenceSync_;
+}
+
+void CLGLContext::setFenceSync(bool f) {
+#ifndef __EMSCRIPTEN__
+    if (f && !(GLEW_VERSION_3_2 || GLEW_ARB_sync)) {
+        std::cerr << "Fence sync objects are not supported. Falling back to glFinish." << std::endl;
+        f = false;
+    }
+    waitForGL();
+    fenceSync_ = f;
+#endif
+}
+
+void CLGLContext::execute(std::function<void(cv::UMat&)> fn, cv::AccessFlag access) {
 #ifndef __EMSCRIPTEN__
     CLExecScope_t clExecScope(getCLExecContext());
 #endif
-    CLGLContext::GLScope glScope(*this);
-    CLGLContext::FrameBufferScope fbScope(*this, frameBuffer_);
+    CLGLContext::FrameBufferScope fbScope(*this, frameBuffer_, access);
     fn(frameBuffer_);
 }
 
@@ -67,13 +96,44 @@ CLExecContext_t& CLGLContext::getCLExecContext() {
 #endif
 
 void CLGLContext::blitFrameBufferToScreen(const cv::Rect& viewport, const cv::Size& windowSize, bool stretch) {
+    syncToGL();
+    //a top-down texture is flipped by swapping the source rows
+    GLint srcY0 = clipControl_ ? frameBufferSize_.height - viewport.y : viewport.y;
+    GLint srcY1 = clipControl_ ? frameBufferSize_.height - (viewport.y + viewport.height) : viewport.y + viewport.height;
     GL_CHECK(glBindFramebuffer(GL_READ_FRAMEBUFFER, frameBufferID_));
     GL_CHECK(glReadBuffer(GL_COLOR_ATTACHMENT0));
     GL_CHECK(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0));
-    GL_CHECK(glBlitFramebuffer(viewport.x, viewport.y, viewport.x + viewport.width, viewport.y + viewport.height,
+    GL_CHECK(glBlitFramebuffer(viewport.x, srcY0, viewport.x + viewport.width, srcY1,
             0, stretch ? 0 : windowSize.height - frameBufferSize_.height, stretch ? windowSize.width : frameBufferSize_.width, windowSize.height, GL_COLOR_BUFFER_BIT, GL_NEAREST));
 }
 
+//other has to be in the same share group and its texture has to be up to date (see syncToGL)
+void CLGLContext::blitFrom(CLGLContext& other) {
+#ifndef __EMSCRIPTEN__
+    //sync objects are shared too. wait on the GPU for the other context to finish rendering.
+    if (other.fence_)
+        GL_CHECK(glWaitSync(other.fence_, 0, GL_TIMEOUT_IGNORED));
+#endif
+    begin();
+    //framebuffer objects aren't shared, textures are
+    if (!readFrameBufferID_)
+        GL_CHECK(glGenFramebuffers(1, &readFrameBufferID_));
+    GL_CHECK(glBindFramebuffer(GL_READ_FRAMEBUFFER, readFrameBufferID_));
+    GL_CHECK(glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, other.textureID_, 0));
+    GL_CHECK(glReadBuffer(GL_COLOR_ATTACHMENT0));
+    GL_CHECK(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frameBufferID_));
+    //flip if the two contexts don't agree on the orientation
+    GLint dstY0 = other.clipControl_ == clipControl_ ? 0 : frameBufferSize_.height;
+    GLint dstY1 = other.clipControl_ == clipControl_ ? frameBufferSize_.height : 0;
+    GL_CHECK(glBlitFramebuffer(0, 0, other.frameBufferSize_.width, other.frameBufferSize_.height,
+            0, dstY0, frameBufferSize_.width, dstY1, GL_COLOR_BUFFER_BIT, GL_LINEAR));
+    GL_CHECK(glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0));
+    GL_CHECK(glBindFramebuffer(GL_READ_FRAMEBUFFER, 0));
+    end();
+    //the framebuffer has been overwritten completely
+    state_ = TEXTURE_NEWER;
+}
+
 void CLGLContext::begin() {
     GL_CHECK(glGetIntegerv( GL_VIEWPORT, viewport_ ));
     GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, frameBufferID_));
@@ -82,19 +142,59 @@ void CLGLContext::begin() {
     GL_CHECK(glBindTexture(GL_TEXTURE_2D, textureID_));
     GL_CHECK(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureID_, 0));
     assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+#ifndef __EMSCRIPTEN__
+    if (clipControl_) {
+        GL_CHECK(glClipControl(GL_UPPER_LEFT, GL_NEGATIVE_ONE_TO_ONE));
+    }
+#endif
 }
 
 void CLGLContext::end() {
+#ifndef __EMSCRIPTEN__
+    //restore the default so rendering to the window (e.g. nanogui) isn't affected
+    if (clipControl_) {
+        GL_CHECK(glClipControl(GL_LOWER_LEFT, GL_NEGATIVE_ONE_TO_ONE));
+    }
+#endif
     GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
     GL_CHECK(glBindRenderbuffer(GL_RENDERBUFFER, 0));
     GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
-    //glFlush seems enough but i wanna make sure that there won't be race conditions.
-    //At least on TigerLake/Iris it doesn't make a difference in performance.
 //    GL_CHECK(glViewport(viewport_[0], viewport_[1], viewport_[2], viewport_[3]));
+#ifndef __EMSCRIPTEN__
+    if (fenceSync_) {
+        //don't wait now. waitForGL() is called when OpenCL actually needs the texture.
+        if (fence_)
+            GL_CHECK(glDeleteSync(fence_));
+        fence_ = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        //flush after creating the fence. glWaitSync in another context (see blitFrom) may never return on an unflushed fence.
+        GL_CHECK(glFlush());
+        return;
+    }
+#endif
     GL_CHECK(glFlush());
+    //glFlush seems enough but i wanna make sure that there won't be race conditions.
+    //At least on TigerLake/Iris it doesn't make a difference in performance.
     GL_CHECK(glFinish());
 }
 
+void CLGLContext::waitForGL() {
+#ifndef __EMSCRIPTEN__
+    if (!fence_)
+        return;
+
+    Tracer::Scope trace(tracer_, "wait for gl");
+    if (!implicitSync_) {
+        GLenum result;
+        do {
+            result = glClientWaitSync(fence_, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        } while (result == GL_TIMEOUT_EXPIRED);
+        assert(result != GL_WAIT_FAILED);
+    }
+    GL_CHECK(glDeleteSync(fence_));
+    fence_ = 0;
+#endif
+}
+
 void CLGLContext::download(cv::UMat& m) {
     cv::Mat tmp = m.getMat(cv::ACCESS_RW);
     assert(tmp.data != nullptr);
@@ -119,7 +219,10 @@ void CLGLContext::upload(const cv::UMat& m) {
     tmp.release();
 }
 
-void CLGLContext::acquireFromGL(cv::UMat &m) {
+void CLGLContext::transferFromGL(cv::UMat &m) {
+    Tracer::Scope trace(tracer_, "clgl acquire");
+    waitForGL();
+    begin();
 #ifndef __EMSCRIPTEN__
     GL_CHECK(cv::ogl::convertFromGLTexture2D(getTexture2D(), m));
 #else
@@ -129,24 +232,68 @@ void CLGLContext::acquireFromGL(cv::UMat &m) {
     GL_CHECK(glFlush());
     GL_CHECK(glFinish());
 #endif
-    //FIXME
-    cv::flip(m, m, 0);
+    if (!clipControl_)
+        cv::flip(m, m, 0);
+    end();
 }
 
-void CLGLContext::releaseToGL(cv::UMat &m) {
-    //FIXME
-    cv::flip(m, m, 0);
-#ifndef __EMSCRIPTEN__
-    GL_CHECK(cv::ogl::convertToGLTexture2D(m, getTexture2D()));
-#else
+void CLGLContext::transferToGL(cv::UMat &m) {
+    Tracer::Scope trace(tracer_, "clgl release");
+    waitForGL();
+    begin();
+#ifdef __EMSCRIPTEN__
     if(m.empty())
         m.create(frameBufferSize_, CV_8UC4);
-    upload(m);
+#endif
+    //don't flip in place because the UMat stays valid after the transfer
+    const cv::UMat* src = &m;
+    if (!clipControl_) {
+        cv::flip(m, flipBuffer_, 0);
+        src = &flipBuffer_;
+    }
+#ifndef __EMSCRIPTEN__
+    GL_CHECK(cv::ogl::convertToGLTexture2D(*src, getTexture2D()));
+#else
+    upload(*src);
     GL_CHECK(glFlush());
     GL_CHECK(glFinish());
 #endif
+    end();
+}
+
+void CLGLContext::syncToGL() {
+    if (state_ == UMAT_NEWER) {
+        transferToGL(frameBuffer_);
+        state_ = IN_SYNC;
+    }
 }
 
+void CLGLContext::acquireFromGL(cv::UMat &m, cv::AccessFlag access) {
+    if (&m != &frameBuffer_) {
+        //UMats other than the framebuffer aren't tracked and always get a copy of the texture.
+        syncToGL();
+        transferFromGL(m);
+        return;
+    }
+
+    //nothing to do if the UMat is up to date or is going to be overwritten anyway
+    if (state_ == TEXTURE_NEWER && (access & cv::ACCESS_READ)) {
+        transferFromGL(m);
+        state_ = IN_SYNC;
+    }
+}
+
+void CLGLContext::releaseToGL(cv::UMat &m, cv::AccessFlag access) {
+    if (&m != &frameBuffer_) {
+        transferToGL(m);
+        state_ = TEXTURE_NEWER;
+        return;
+    }
+
+    //the texture is only updated once GL actually needs it (see syncToGL)
+    if (access & cv::ACCESS_WRITE)
+        state_ = UMAT_NEWER;
+}
 }
 }
 }
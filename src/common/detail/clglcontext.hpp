@@ -20,6 +20,7 @@
 #include <iostream>
 
 #include "../util.hpp"
+#include "../tracer.hpp"
 
 namespace kb {
 namespace viz2d {
@@ -35,7 +36,15 @@ class CLGLContext {
     GLuint frameBufferID_ = 0;
     GLuint textureID_ = 0;
     GLuint renderBufferID_ = 0;
+    //only used to read from the texture of another context
+    GLuint readFrameBufferID_ = 0;
     GLint viewport_[4];
+    bool clipControl_ = false;
+    bool fenceSync_ = false;
+    bool implicitSync_ = false;
+    GLsync fence_ = 0;
+    //set by Viz2D::tracer()
+    Tracer* tracer_ = nullptr;
 #ifndef __EMSCRIPTEN__
     CLExecContext_t context_;
 #endif
@@ -45,17 +54,26 @@ class CLGLContext {
     CLExecContext_t& getCLExecContext();
 #endif
     void blitFrameBufferToScreen(const cv::Rect& viewport, const cv::Size& windowSize, bool stretch = false);
+    void blitFrom(CLGLContext& other);
 public:
+    //Which side holds the latest contents of the framebuffer
+    enum FrameBufferState {
+        IN_SYNC,
+        TEXTURE_NEWER,
+        UMAT_NEWER
+    };
+
     class FrameBufferScope {
         CLGLContext& ctx_;
         cv::UMat& m_;
+        cv::AccessFlag access_;
     public:
-        FrameBufferScope(CLGLContext& ctx, cv::UMat& m) : ctx_(ctx), m_(m) {
-            ctx_.acquireFromGL(m_);
+        FrameBufferScope(CLGLContext& ctx, cv::UMat& m, cv::AccessFlag access = cv::ACCESS_RW) : ctx_(ctx), m_(m), access_(access) {
+            ctx_.acquireFromGL(m_, access_);
         }
 
         ~FrameBufferScope() {
-            ctx_.releaseToGL(m_);
+            ctx_.releaseToGL(m_, access_);
         }
     };
 
@@ -63,27 +81,40 @@ public:
         CLGLContext& ctx_;
     public:
         GLScope(CLGLContext& ctx) : ctx_(ctx) {
+            ctx_.syncToGL();
             ctx_.begin();
         }
 
         ~GLScope() {
             ctx_.end();
+            //we have to assume that GL rendered to the texture
+            ctx_.state_ = TEXTURE_NEWER;
         }
     };
 
-    CLGLContext(const cv::Size& frameBufferSize);
+    //a context that shares its GL objects with the context of shared also uses its OpenCL context
+    CLGLContext(const cv::Size& frameBufferSize, CLGLContext* shared = nullptr);
     virtual ~CLGLContext();
     cv::Size getSize();
-    void execute(std::function<void(cv::UMat&)> fn);
+    FrameBufferState getState();
+    bool isFenceSync();
+    void setFenceSync(bool f);
+    void execute(std::function<void(cv::UMat&)> fn, cv::AccessFlag access = cv::ACCESS_RW);
 protected:
     void begin();
     void end();
     void download(cv::UMat& m);
     void upload(const cv::UMat& m);
-    void acquireFromGL(cv::UMat &m);
-    void releaseToGL(cv::UMat &m);
+    void acquireFromGL(cv::UMat &m, cv::AccessFlag access = cv::ACCESS_RW);
+    void releaseToGL(cv::UMat &m, cv::AccessFlag access = cv::ACCESS_RW);
+    void syncToGL();
+    void waitForGL();
+    void transferFromGL(cv::UMat &m);
+    void transferToGL(cv::UMat &m);
     cv::UMat frameBuffer_;
+    cv::UMat flipBuffer_;
     cv::ogl::Texture2D* texture_ = nullptr;
+    FrameBufferState state_ = TEXTURE_NEWER;
 };
 }
 }
@@ -1,4 +1,5 @@
 #include "clvacontext.hpp"
+#include "colorconv.hpp"
 
 #include "../viz2d.hpp"
 
@@ -10,6 +11,11 @@ CLVAContext::CLVAContext(CLGLContext &clglContext) :
         clglContext_(clglContext) {
 }
 
+CLVAContext::~CLVAContext() {
+    if (asyncWriter_)
+        delete asyncWriter_;
+}
+
 void CLVAContext::setVideoFrameSize(const cv::Size& sz) {
     if(videoFrameSize_ != cv::Size(0,0))
         assert(videoFrameSize_ == sz || "Input and output video sizes don't match");
@@ -35,34 +41,45 @@ bool CLVAContext::capture(std::function<void(cv::UMat&)> fn) {
             videoFrameSize_ = videoFrame_.size();
         }
     }
+    if (videoFrame_.empty())
+        return false;
+
     {
 #ifndef __EMSCRIPTEN__
         CLExecScope_t scope(clglContext_.getCLExecContext());
 #endif
-        CLGLContext::GLScope glScope(clglContext_);
-        CLGLContext::FrameBufferScope fbScope(clglContext_, frameBuffer_);
-        if (videoFrame_.empty())
-            return false;
+        //the framebuffer is overwritten completely, so there is no need to fetch it from GL
+        cv::UMat& frameBuffer = clglContext_.frameBuffer_;
+        CLGLContext::FrameBufferScope fbScope(clglContext_, frameBuffer, cv::ACCESS_WRITE);
 
         cv::Size fbSize = clglContext_.getSize();
-        cv::resize(videoFrame_, rgbBuffer_, fbSize);
-        cv::cvtColor(rgbBuffer_, frameBuffer_, cv::COLOR_RGB2BGRA);
+        resizeSwapRB(videoFrame_, frameBuffer, fbSize, 4);
 
-        assert(frameBuffer_.size() == fbSize);
+        assert(frameBuffer.size() == fbSize);
     }
     return true;
 }
 
 void CLVAContext::write(std::function<void(const cv::UMat&)> fn) {
+    if (asyncWriter_) {
+        //only take a snapshot of the framebuffer. conversion and encoding happen on the encoder thread.
+#ifndef __EMSCRIPTEN__
+        CLExecScope_t scope(clglContext_.getCLExecContext());
+#endif
+        CLGLContext::FrameBufferScope fbScope(clglContext_, clglContext_.frameBuffer_, cv::ACCESS_READ);
+        asyncWriter_->push(clglContext_.frameBuffer_, [=, this](const cv::UMat& snapshot) {
+            this->encode(snapshot, fn);
+        });
+        return;
+    }
+
     {
 #ifndef __EMSCRIPTEN__
         CLExecScope_t scope(clglContext_.getCLExecContext());
 #endif
-        CLGLContext::GLScope glScope(clglContext_);
-        CLGLContext::FrameBufferScope fbScope(clglContext_, frameBuffer_);
+        CLGLContext::FrameBufferScope fbScope(clglContext_, clglContext_.frameBuffer_, cv::ACCESS_READ);
 
-        cv::cvtColor(frameBuffer_, rgbBuffer_, cv::COLOR_BGRA2RGB);
-        cv::resize(rgbBuffer_, videoFrame_, videoFrameSize_);
+        resizeSwapRB(clglContext_.frameBuffer_, videoFrame_, videoFrameSize_, 3);
     }
     assert(videoFrame_.size() == videoFrameSize_);
     {
@@ -73,6 +90,47 @@ void CLVAContext::write(std::function<void(const cv::UMat&)> fn) {
     }
 }
 
+void CLVAContext::encode(const cv::UMat& frameBuffer, std::function<void(const cv::UMat&)> fn) {
+    {
+#ifndef __EMSCRIPTEN__
+        CLExecScope_t scope(encoderContext_);
+#endif
+        resizeSwapRB(frameBuffer, encoderVideoFrame_, videoFrameSize_, 3);
+#ifndef __EMSCRIPTEN__
+        cv::ocl::finish();
+#endif
+    }
+    assert(encoderVideoFrame_.size() == videoFrameSize_);
+    if (!context_.empty()) {
+#ifndef __EMSCRIPTEN__
+        CLExecScope_t scope(context_);
+#endif
+        fn(encoderVideoFrame_);
+    } else {
+        fn(encoderVideoFrame_);
+    }
+}
+
+void CLVAContext::setAsyncWriter(size_t depth, bool dropWhenFull) {
+    if (asyncWriter_) {
+        delete asyncWriter_;
+        asyncWriter_ = nullptr;
+    }
+
+    if (depth > 0) {
+#ifndef __EMSCRIPTEN__
+        //the encoder thread gets its own queue so it doesn't contend with the render thread
+        encoderContext_ = clglContext_.getCLExecContext().cloneWithNewQueue();
+#endif
+        asyncWriter_ = new AsyncWriter(depth, dropWhenFull);
+    }
+}
+
+void CLVAContext::flush() {
+    if (asyncWriter_)
+        asyncWriter_->flush();
+}
+
 bool CLVAContext::hasContext() {
     return !context_.empty();
 }
@@ -2,6 +2,7 @@
 #define SRC_COMMON_CLVACONTEXT_HPP_
 
 #include "clglcontext.hpp"
+#include "asyncwriter.hpp"
 
 namespace kb {
 namespace viz2d {
@@ -12,18 +13,25 @@ class CLVAContext {
     friend class kb::viz2d::Viz2D;
     CLExecContext_t context_;
     CLGLContext &clglContext_;
-    cv::UMat frameBuffer_;
     cv::UMat videoFrame_;
-    cv::UMat rgbBuffer_;
+    cv::UMat encoderVideoFrame_;
     bool hasContext_ = false;
     cv::Size videoFrameSize_;
+    AsyncWriter* asyncWriter_ = nullptr;
+#ifndef __EMSCRIPTEN__
+    CLExecContext_t encoderContext_;
+#endif
     CLExecContext_t getCLExecContext();
+    void encode(const cv::UMat& frameBuffer, std::function<void(const cv::UMat&)> fn);
 public:
     CLVAContext(CLGLContext &fbContext);
+    virtual ~CLVAContext();
     cv::Size getVideoFrameSize();
     void setVideoFrameSize(const cv::Size& sz);
     bool capture(std::function<void(cv::UMat&)> fn);
     void write(std::function<void(const cv::UMat&)> fn);
+    void setAsyncWriter(size_t depth, bool dropWhenFull);
+    void flush();
     /*FIXME only public till https://github.com/opencv/opencv/pull/22780 is resolved.
      * required for manual initialization of VideoCapture/VideoWriter
      */
@@ -0,0 +1,166 @@
+#include "colorconv.hpp"
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/core/ocl.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <vector>
+
+namespace kb {
+namespace viz2d {
+namespace detail {
+
+#ifndef __EMSCRIPTEN__
+//same pixel center convention as cv::resize with INTER_LINEAR
+static cv::ocl::ProgramSource resize_swap_rb_source(R"CLC(
+#if SCN == 3
+#define LOAD(p) (float4)(convert_float3(vload3(0, p)), 255.0f)
+#else
+#define LOAD(p) convert_float4(vload4(0, p))
+#endif
+
+__kernel void resize_swap_rb(__global const uchar* src, int src_step, int src_offset, int src_rows, int src_cols,
+        __global uchar* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+        float ifx, float ify) {
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= dst_cols || y >= dst_rows)
+        return;
+
+    float fx = ((float)x + 0.5f) * ifx - 0.5f;
+    float fy = ((float)y + 0.5f) * ify - 0.5f;
+    float x0f = floor(fx);
+    float y0f = floor(fy);
+    float ax = fx - x0f;
+    float ay = fy - y0f;
+    int x0 = clamp((int)x0f, 0, src_cols - 1);
+    int x1 = clamp((int)x0f + 1, 0, src_cols - 1);
+    int y0 = clamp((int)y0f, 0, src_rows - 1);
+    int y1 = clamp((int)y0f + 1, 0, src_rows - 1);
+
+    __global const uchar* r0 = src + src_offset + y0 * src_step;
+    __global const uchar* r1 = src + src_offset + y1 * src_step;
+    float4 top = mix(LOAD(r0 + x0 * SCN), LOAD(r0 + x1 * SCN), ax);
+    float4 bottom = mix(LOAD(r1 + x0 * SCN), LOAD(r1 + x1 * SCN), ax);
+    uchar4 px = convert_uchar4_sat_rte(mix(top, bottom, ay));
+
+    __global uchar* d = dst + dst_offset + y * dst_step + x * DCN;
+#if DCN == 3
+    vstore3(px.zyx, 0, d);
+#else
+    vstore4(px.zyxw, 0, d);
+#endif
+}
+)CLC");
+
+static bool ocl_resizeSwapRB(const cv::UMat& src, cv::UMat& dst, const cv::Size& sz, int dcn) {
+    cv::ocl::Kernel k("resize_swap_rb", resize_swap_rb_source, cv::format("-D SCN=%d -D DCN=%d", src.channels(), dcn));
+    if (k.empty())
+        return false;
+
+    dst.create(sz, CV_MAKETYPE(CV_8U, dcn));
+    k.args(cv::ocl::KernelArg::ReadOnly(src), cv::ocl::KernelArg::WriteOnly(dst),
+            float(src.cols) / sz.width, float(src.rows) / sz.height);
+    size_t globalsize[2] = { size_t(sz.width), size_t(sz.height) };
+    return k.run(2, globalsize, nullptr, false);
+}
+#endif
+
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+//h0 + (h1 - h0) * b, rounded
+static inline cv::v_int32 v_blendRows(const float* h0, const float* h1, const cv::v_float32& b) {
+    cv::v_float32 a0 = cv::vx_load(h0);
+    return cv::v_round(cv::v_fma(cv::v_sub(cv::vx_load(h1), a0), b, a0));
+}
+#endif
+
+//blends two horizontally interpolated rows and packs the result to 8 bit
+static void blendRows(const float* h0, const float* h1, float b, uchar* d, int len) {
+    int i = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    //no arrays of vectors, they are sizeless types with scalable SIMD
+    const int vlanes = cv::VTraits<cv::v_uint8>::vlanes();
+    const int flanes = cv::VTraits<cv::v_float32>::vlanes();
+    const cv::v_float32 vb = cv::vx_setall_f32(b);
+    for (; i <= len - vlanes; i += vlanes) {
+        cv::v_int16 lo = cv::v_pack(v_blendRows(h0 + i, h1 + i, vb), v_blendRows(h0 + i + flanes, h1 + i + flanes, vb));
+        cv::v_int16 hi = cv::v_pack(v_blendRows(h0 + i + 2 * flanes, h1 + i + 2 * flanes, vb), v_blendRows(h0 + i + 3 * flanes, h1 + i + 3 * flanes, vb));
+        cv::v_store(d + i, cv::v_pack_u(lo, hi));
+    }
+#endif
+    for (; i < len; ++i)
+        d[i] = cv::saturate_cast<uchar>(h0[i] + (h1[i] - h0[i]) * b);
+}
+
+static void cpu_resizeSwapRB(const cv::Mat& src, cv::Mat& dst, int dcn) {
+    const int scn = src.channels();
+    const int swizzle[4] = { 2, 1, 0, 3 };
+    const float ifx = float(src.cols) / dst.cols;
+    const float ify = float(src.rows) / dst.rows;
+
+    std::vector<int> xofs(dst.cols * 2);
+    std::vector<float> xalpha(dst.cols);
+    for (int x = 0; x < dst.cols; ++x) {
+        float fx = (x + 0.5f) * ifx - 0.5f;
+        int x0 = cvFloor(fx);
+        xalpha[x] = fx - x0;
+        xofs[x * 2] = std::min(std::max(x0, 0), src.cols - 1) * scn;
+        xofs[x * 2 + 1] = std::min(std::max(x0 + 1, 0), src.cols - 1) * scn;
+    }
+
+    auto interpolateRow = [&](const uchar* s, float* h) {
+        for (int x = 0; x < dst.cols; ++x) {
+            const uchar* p0 = s + xofs[x * 2];
+            const uchar* p1 = s + xofs[x * 2 + 1];
+            float a = xalpha[x];
+            for (int c = 0; c < dcn; ++c) {
+                int sc = swizzle[c];
+                if (sc < scn)
+                    h[x * dcn + c] = p0[sc] + (p1[sc] - p0[sc]) * a;
+                else
+                    h[x * dcn + c] = 255.0f;
+            }
+        }
+    };
+
+    cv::parallel_for_(cv::Range(0, dst.rows), [&](const cv::Range& range) {
+        const int len = dst.cols * dcn;
+        std::vector<float> h0(len);
+        std::vector<float> h1(len);
+        for (int y = range.start; y < range.end; ++y) {
+            float fy = (y + 0.5f) * ify - 0.5f;
+            int y0 = cvFloor(fy);
+            float b = fy - y0;
+            interpolateRow(src.ptr(std::min(std::max(y0, 0), src.rows - 1)), h0.data());
+            interpolateRow(src.ptr(std::min(std::max(y0 + 1, 0), src.rows - 1)), h1.data());
+            blendRows(h0.data(), h1.data(), b, dst.ptr(y), len);
+        }
+    });
+}
+
+void resizeSwapRB(const cv::UMat& src, cv::UMat& dst, const cv::Size& sz, int dcn) {
+    const int scn = src.channels();
+    CV_Assert(src.depth() == CV_8U && (scn == 3 || scn == 4) && (dcn == 3 || dcn == 4));
+
+    if (src.size() == sz) {
+        //cvtColor already converts in a single pass
+        if (dcn == 4)
+            cv::cvtColor(src, dst, scn == 3 ? cv::COLOR_RGB2BGRA : cv::COLOR_RGBA2BGRA);
+        else
+            cv::cvtColor(src, dst, scn == 3 ? cv::COLOR_BGR2RGB : cv::COLOR_BGRA2RGB);
+        return;
+    }
+
+#ifndef __EMSCRIPTEN__
+    if (cv::ocl::useOpenCL() && ocl_resizeSwapRB(src, dst, sz, dcn))
+        return;
+#endif
+
+    dst.create(sz, CV_MAKETYPE(CV_8U, dcn));
+    cv::Mat s = src.getMat(cv::ACCESS_READ);
+    cv::Mat d = dst.getMat(cv::ACCESS_WRITE);
+    cpu_resizeSwapRB(s, d, dcn);
+}
+}
+}
+}
@@ -0,0 +1,20 @@
+#ifndef SRC_COMMON_COLORCONV_HPP_
+#define SRC_COMMON_COLORCONV_HPP_
+
+#include <opencv2/core.hpp>
+
+namespace kb {
+namespace viz2d {
+namespace detail {
+
+/*!
+ * Bilinearly resizes an 8-bit 3- or 4-channel image to sz and swaps the red and blue channel in one pass.
+ * The result has dcn (3 or 4) channels. A missing alpha channel is filled with 255.
+ * If the sizes match the resize is skipped and only the color conversion is performed.
+ */
+void resizeSwapRB(const cv::UMat& src, cv::UMat& dst, const cv::Size& sz, int dcn);
+}
+}
+}
+
+#endif /* SRC_COMMON_COLORCONV_HPP_ */
@@ -0,0 +1,159 @@
+#ifndef __EMSCRIPTEN__
+#include "headlesscontext.hpp"
+
+#include <GL/glew.h>
+#define NANOVG_GL3
+#include <nanovg.h>
+#include <nanovg_gl.h>
+#include <iostream>
+#include <string>
+
+namespace kb {
+namespace viz2d {
+namespace detail {
+
+static bool has_extension(const char* extensions, const std::string& name) {
+    return extensions != nullptr && std::string(extensions).find(name) != std::string::npos;
+}
+
+EGLDisplay HeadlessContext::getDisplay() {
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+    if (getPlatformDisplay) {
+        if (has_extension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+            EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if (display != EGL_NO_DISPLAY)
+                return display;
+        }
+
+        //e.g. the nvidia driver doesn't know the mesa platform but exposes its devices
+        auto queryDevices = (PFNEGLQUERYDEVICESEXTPROC) eglGetProcAddress("eglQueryDevicesEXT");
+        if (queryDevices && has_extension(clientExtensions, "EGL_EXT_platform_device")) {
+            EGLDeviceEXT device;
+            EGLint numDevices = 0;
+            if (queryDevices(1, &device, &numDevices) && numDevices > 0) {
+                EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, device, nullptr);
+                if (display != EGL_NO_DISPLAY)
+                    return display;
+            }
+        }
+    }
+
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+HeadlessContext::HeadlessContext(int major, int minor, bool debug, HeadlessContext* shared) {
+    display_ = getDisplay();
+    EGLint eglMajor, eglMinor;
+    if (display_ == EGL_NO_DISPLAY || !eglInitialize(display_, &eglMajor, &eglMinor)) {
+        std::cerr << "Unable to initialize EGL display" << std::endl;
+        display_ = EGL_NO_DISPLAY;
+        return;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cerr << "EGL doesn't support desktop OpenGL" << std::endl;
+        return;
+    }
+
+    bool surfaceless = has_extension(eglQueryString(display_, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_DEPTH_SIZE, 24,
+        EGL_STENCIL_SIZE, 8,
+        EGL_NONE
+    };
+
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if (!eglChooseConfig(display_, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+        std::cerr << "No suitable EGL config found" << std::endl;
+        return;
+    }
+
+    //same profile as the windowed context. NanoVGContext relies on glPushAttrib.
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, major,
+        EGL_CONTEXT_MINOR_VERSION_KHR, minor,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT_KHR,
+        EGL_CONTEXT_FLAGS_KHR, debug ? EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR : 0,
+        EGL_NONE
+    };
+
+    //the display is the same for all instances, so sharing is always possible
+    context_ = eglCreateContext(display_, config, shared ? shared->context_ : EGL_NO_CONTEXT, contextAttribs);
+    if (context_ == EGL_NO_CONTEXT) {
+        std::cerr << "Unable to create EGL context: " << std::hex << eglGetError() << std::dec << std::endl;
+        return;
+    }
+
+    if (!surfaceless) {
+        //we render into our own framebuffer object. the surface only exists to make the context current.
+        const EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        surface_ = eglCreatePbufferSurface(display_, config, pbufferAttribs);
+        if (surface_ == EGL_NO_SURFACE) {
+            std::cerr << "Unable to create EGL pbuffer surface" << std::endl;
+            eglDestroyContext(display_, context_);
+            context_ = EGL_NO_CONTEXT;
+            return;
+        }
+    }
+
+    makeCurrent();
+    glewExperimental = true;
+    GLenum err = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    //a GLX build of GLEW can't find a GLX display under EGL, but the GL entry points are loaded anyway
+    if (err == GLEW_ERROR_NO_GLX_DISPLAY)
+        err = GLEW_OK;
+#endif
+    if (err != GLEW_OK) {
+        std::cerr << "Unable to initialize GLEW: " << glewGetErrorString(err) << std::endl;
+        eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display_, context_);
+        context_ = EGL_NO_CONTEXT;
+        return;
+    }
+    nvgContext_ = nvgCreateGL3(NVG_STENCIL_STROKES | NVG_ANTIALIAS | (debug ? NVG_DEBUG : 0));
+    if (nvgContext_ == nullptr)
+        std::cerr << "Unable to create NanoVG context" << std::endl;
+}
+
+HeadlessContext::~HeadlessContext() {
+    if (context_ != EGL_NO_CONTEXT) {
+        makeCurrent();
+        if (nvgContext_)
+            nvgDeleteGL3(nvgContext_);
+        eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display_, context_);
+    }
+    if (surface_ != EGL_NO_SURFACE)
+        eglDestroySurface(display_, surface_);
+    //don't terminate the display. it is shared by all headless instances.
+}
+
+bool HeadlessContext::isValid() {
+    return context_ != EGL_NO_CONTEXT && nvgContext_ != nullptr;
+}
+
+void HeadlessContext::makeCurrent() {
+    eglMakeCurrent(display_, surface_, surface_, context_);
+}
+
+bool HeadlessContext::isCurrent() {
+    return eglGetCurrentContext() == context_;
+}
+
+NVGcontext* HeadlessContext::getNVGcontext() {
+    return nvgContext_;
+}
+}
+}
+}
+#endif
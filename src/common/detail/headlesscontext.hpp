@@ -0,0 +1,45 @@
+#ifndef SRC_COMMON_HEADLESSCONTEXT_HPP_
+#define SRC_COMMON_HEADLESSCONTEXT_HPP_
+
+#ifndef __EMSCRIPTEN__
+//keep X11 macros like None and Status out of our code
+#ifndef EGL_NO_X11
+#define EGL_NO_X11
+#endif
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+struct NVGcontext;
+
+namespace kb {
+namespace viz2d {
+namespace detail {
+
+/*!
+ * A GL context without window, GLFW or nanogui. Prefers a surfaceless EGL display (EGL_MESA_platform_surfaceless or
+ * the first EGL device) and falls back to a pbuffer surface if EGL_KHR_surfaceless_context isn't available.
+ * Also owns the NanoVG context that the nanogui screen would otherwise provide.
+ */
+class HeadlessContext {
+    EGLDisplay display_ = EGL_NO_DISPLAY;
+    EGLContext context_ = EGL_NO_CONTEXT;
+    EGLSurface surface_ = EGL_NO_SURFACE;
+    NVGcontext* nvgContext_ = nullptr;
+
+    EGLDisplay getDisplay();
+public:
+    //if shared is given both contexts are in the same share group
+    HeadlessContext(int major, int minor, bool debug, HeadlessContext* shared = nullptr);
+    virtual ~HeadlessContext();
+    bool isValid();
+    void makeCurrent();
+    //asks EGL, so it is also right if somebody else switched contexts
+    bool isCurrent();
+    NVGcontext* getNVGcontext();
+};
+}
+}
+}
+#endif
+
+#endif /* SRC_COMMON_HEADLESSCONTEXT_HPP_ */
@@ -56,10 +56,8 @@ void NanoVGContext::begin() {
     float r = v2d_.getXPixelRatio();
 
     nvgSave(context_);
+    //no mirroring required. the orientation of the framebuffer is handled by CLGLContext::begin()
     nvgBeginFrame(context_, w, h, r);
-//FIXME mirroring with text somehow doesn't work
-//    nvgTranslate(context_, 0, h);
-//    nvgScale(context_, 1, -1);
     GL_CHECK(glViewport(0, 0, w, h));
 }
 
@@ -0,0 +1,520 @@
+#include "effects.hpp"
+#include "framearena.hpp"
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/core/ocl.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+namespace kb {
+namespace viz2d {
+
+#ifndef __EMSCRIPTEN__
+//blurring the inverted image is the same as inverting the blurred image, so all but the last kernel work on src as it is
+static cv::ocl::ProgramSource glow_source(R"CLC(
+//downscales by half (2x2 average) and sums ksize pixels horizontally
+__kernel void glow_down_hblur(__global const uchar* src, int src_step, int src_offset, int src_rows, int src_cols,
+        __global uchar* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols, int anchor, int ksize) {
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= dst_cols || y >= dst_rows)
+        return;
+
+    __global const uchar* r0 = src + src_offset + min(2 * y, src_rows - 1) * src_step;
+    __global const uchar* r1 = src + src_offset + min(2 * y + 1, src_rows - 1) * src_step;
+    int4 sum = (int4)(0);
+    for (int k = 0; k < ksize; ++k) {
+        int sx = clamp(x + k - anchor, 0, dst_cols - 1) * 2;
+        int sx1 = min(sx + 1, src_cols - 1);
+        sum += convert_int4(vload4(sx, r0)) + convert_int4(vload4(sx1, r0)) + convert_int4(vload4(sx, r1)) + convert_int4(vload4(sx1, r1));
+    }
+    vstore4(sum, x, (__global int*)(dst + dst_offset + y * dst_step));
+}
+
+//sums ksize rows and normalizes
+__kernel void glow_vblur(__global const uchar* src, int src_step, int src_offset, int src_rows, int src_cols,
+        __global uchar* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols, int anchor, int ksize, float scale) {
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= dst_cols || y >= dst_rows)
+        return;
+
+    int4 sum = (int4)(0);
+    for (int k = 0; k < ksize; ++k) {
+        int sy = clamp(y + k - anchor, 0, src_rows - 1);
+        sum += vload4(x, (__global const int*)(src + src_offset + sy * src_step));
+    }
+    vstore4(convert_uchar4_sat_rte(convert_float4(sum) * scale), x, dst + dst_offset + y * dst_step);
+}
+
+//upscales the blurred image bilinearly (same pixel centers as cv::resize) and combines it with src
+__kernel void glow_compose(__global const uchar* src, int src_step, int src_offset,
+        __global const uchar* blurred, int blurred_step, int blurred_offset, int blurred_rows, int blurred_cols,
+        __global uchar* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols, float ifx, float ify) {
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= dst_cols || y >= dst_rows)
+        return;
+
+    float fx = ((float)x + 0.5f) * ifx - 0.5f;
+    float fy = ((float)y + 0.5f) * ify - 0.5f;
+    float x0f = floor(fx);
+    float y0f = floor(fy);
+    int x0 = clamp((int)x0f, 0, blurred_cols - 1);
+    int x1 = clamp((int)x0f + 1, 0, blurred_cols - 1);
+    __global const uchar* b0 = blurred + blurred_offset + clamp((int)y0f, 0, blurred_rows - 1) * blurred_step;
+    __global const uchar* b1 = blurred + blurred_offset + clamp((int)y0f + 1, 0, blurred_rows - 1) * blurred_step;
+    float4 top = mix(convert_float4(vload4(x0, b0)), convert_float4(vload4(x1, b0)), fx - x0f);
+    float4 bottom = mix(convert_float4(vload4(x0, b1)), convert_float4(vload4(x1, b1)), fx - x0f);
+    float4 b = mix(top, bottom, fy - y0f);
+
+    float4 s = convert_float4(vload4(x, src + src_offset + y * src_step));
+    float4 glow = 255.0f - (255.0f - s) * (255.0f - b) * (1.0f / 255.0f);
+    vstore4(convert_uchar4_sat_rte(glow), x, dst + dst_offset + y * dst_step);
+}
+)CLC");
+
+static bool ocl_glow(FrameArena& arena, const cv::UMat& src, cv::UMat& dst, int ksize) {
+    cv::Size half(src.cols / 2, src.rows / 2);
+    int anchor = ksize / 2;
+    cv::UMat sums = arena.get(half, CV_32SC4);
+    cv::UMat blurred = arena.get(half, CV_8UC4);
+    size_t halfSize[2] = { size_t(half.width), size_t(half.height) };
+    size_t fullSize[2] = { size_t(src.cols), size_t(src.rows) };
+
+    cv::ocl::Kernel down("glow_down_hblur", glow_source);
+    cv::ocl::Kernel vblur("glow_vblur", glow_source);
+    cv::ocl::Kernel compose("glow_compose", glow_source);
+    if (down.empty() || vblur.empty() || compose.empty())
+        return false;
+
+    down.args(cv::ocl::KernelArg::ReadOnly(src), cv::ocl::KernelArg::WriteOnly(sums), anchor, ksize);
+    if (!down.run(2, halfSize, nullptr, false))
+        return false;
+
+    vblur.args(cv::ocl::KernelArg::ReadOnly(sums), cv::ocl::KernelArg::WriteOnly(blurred), anchor, ksize, 1.0f / (4 * ksize * ksize));
+    if (!vblur.run(2, halfSize, nullptr, false))
+        return false;
+
+    dst.create(src.size(), src.type());
+    compose.args(cv::ocl::KernelArg::ReadOnlyNoSize(src), cv::ocl::KernelArg::ReadOnly(blurred), cv::ocl::KernelArg::WriteOnly(dst),
+            float(half.width) / src.cols, float(half.height) / src.rows);
+    return compose.run(2, fullSize, nullptr, false);
+}
+
+//lightness * (1 - saturation) of HLS is min(b, g, r) for dark pixels (l < 0.5) and sum * (255 - max) / (510 - sum) with
+//sum = max + min for bright ones. the threshold test of the latter doesn't need the division.
+static cv::ocl::ProgramSource bloom_source(R"CLC(
+inline int bloom_mask(uchar4 p, int thresh) {
+    int mx = max(max(p.x, p.y), p.z);
+    int mn = min(min(p.x, p.y), p.z);
+    int sum = mx + mn;
+    if (sum < 255 || mx == mn)
+        return mn > thresh ? 255 : 0;
+    return sum * (255 - mx) > thresh * (510 - sum) ? 255 : 0;
+}
+
+//thresholds the mask of src and downscales it by half (2x2 average)
+__kernel void bloom_mask_down(__global const uchar* src, int src_step, int src_offset, int src_rows, int src_cols,
+        __global uchar* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols, int thresh) {
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= dst_cols || y >= dst_rows)
+        return;
+
+    __global const uchar* r0 = src + src_offset + min(2 * y, src_rows - 1) * src_step;
+    __global const uchar* r1 = src + src_offset + min(2 * y + 1, src_rows - 1) * src_step;
+    int sx = 2 * x;
+    int sx1 = min(sx + 1, src_cols - 1);
+    int sum = bloom_mask(vload4(sx, r0), thresh) + bloom_mask(vload4(sx1, r0), thresh) + bloom_mask(vload4(sx, r1), thresh) + bloom_mask(vload4(sx1, r1), thresh);
+    dst[dst_offset + y * dst_step + x] = (uchar)((sum + 2) >> 2);
+}
+
+//upscales the blurred mask bilinearly (same pixel centers as cv::resize) and adds it to src with gain
+__kernel void bloom_compose(__global const uchar* src, int src_step, int src_offset,
+        __global const uchar* mask, int mask_step, int mask_offset, int mask_rows, int mask_cols,
+        __global uchar* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols, float ifx, float ify, float gain) {
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= dst_cols || y >= dst_rows)
+        return;
+
+    float fx = ((float)x + 0.5f) * ifx - 0.5f;
+    float fy = ((float)y + 0.5f) * ify - 0.5f;
+    float x0f = floor(fx);
+    float y0f = floor(fy);
+    int x0 = clamp((int)x0f, 0, mask_cols - 1);
+    int x1 = clamp((int)x0f + 1, 0, mask_cols - 1);
+    __global const uchar* m0 = mask + mask_offset + clamp((int)y0f, 0, mask_rows - 1) * mask_step;
+    __global const uchar* m1 = mask + mask_offset + clamp((int)y0f + 1, 0, mask_rows - 1) * mask_step;
+    float top = mix((float)m0[x0], (float)m0[x1], fx - x0f);
+    float bottom = mix((float)m1[x0], (float)m1[x1], fx - x0f);
+    float m = mix(top, bottom, fy - y0f);
+
+    float4 s = convert_float4(vload4(x, src + src_offset + y * src_step));
+    vstore4(convert_uchar4_sat_rte(s + m * gain), x, dst + dst_offset + y * dst_step);
+}
+)CLC");
+
+static bool ocl_bloom(FrameArena& arena, const cv::UMat& src, cv::UMat& dst, int ksize, int thresh, float gain) {
+    cv::Size half(src.cols / 2, src.rows / 2);
+    cv::UMat mask = arena.get(half, CV_8UC1);
+    cv::UMat blurred = arena.get(half, CV_8UC1);
+    size_t halfSize[2] = { size_t(half.width), size_t(half.height) };
+    size_t fullSize[2] = { size_t(src.cols), size_t(src.rows) };
+
+    cv::ocl::Kernel down("bloom_mask_down", bloom_source);
+    cv::ocl::Kernel compose("bloom_compose", bloom_source);
+    if (down.empty() || compose.empty())
+        return false;
+
+    down.args(cv::ocl::KernelArg::ReadOnly(src), cv::ocl::KernelArg::WriteOnly(mask), thresh);
+    if (!down.run(2, halfSize, nullptr, false))
+        return false;
+
+    //the mask is small, cv::boxFilter is good enough
+    cv::boxFilter(mask, blurred, -1, cv::Size(ksize, ksize), cv::Point(-1, -1), true, cv::BORDER_REPLICATE);
+
+    dst.create(src.size(), src.type());
+    compose.args(cv::ocl::KernelArg::ReadOnlyNoSize(src), cv::ocl::KernelArg::ReadOnly(blurred), cv::ocl::KernelArg::WriteOnly(dst),
+            float(half.width) / src.cols, float(half.height) / src.rows, gain);
+    return compose.run(2, fullSize, nullptr, false);
+}
+#endif
+
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+//vectors are sizeless types with scalable SIMD, so the compose loops use helpers instead of arrays of vectors
+
+//h0 + (h1 - h0) * b
+static inline cv::v_float32 v_blendRows(const float* h0, const float* h1, const cv::v_float32& b) {
+    cv::v_float32 a0 = cv::vx_load(h0);
+    return cv::v_fma(cv::v_sub(cv::vx_load(h1), a0), b, a0);
+}
+
+static inline cv::v_float32 v_toFloat(const cv::v_uint32& s) {
+    return cv::v_cvt_f32(cv::v_reinterpret_as_s32(s));
+}
+
+//255 - (255 - s) * (255 - blurred) / 255
+static inline cv::v_int32 v_glow(const cv::v_uint32& s, const cv::v_float32& blurred) {
+    const cv::v_float32 v255 = cv::vx_setall_f32(255.0f);
+    cv::v_float32 product = cv::v_mul(cv::v_sub(v255, v_toFloat(s)), cv::v_sub(v255, blurred));
+    return cv::v_round(cv::v_sub(v255, cv::v_mul(product, cv::vx_setall_f32(1.0f / 255.0f))));
+}
+
+//s + mask * gain
+static inline cv::v_int32 v_bloom(const cv::v_uint32& s, const cv::v_float32& mask, const cv::v_float32& gain) {
+    return cv::v_round(cv::v_fma(mask, gain, v_toFloat(s)));
+}
+#endif
+
+//upscales two blurred rows, blends them and combines the result with src
+static void composeGlowRow(const float* h0, const float* h1, float b, const uchar* s, uchar* d, int len) {
+    int i = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int vlanes = cv::VTraits<cv::v_uint8>::vlanes();
+    const int flanes = cv::VTraits<cv::v_float32>::vlanes();
+    const cv::v_float32 vb = cv::vx_setall_f32(b);
+    for (; i <= len - vlanes; i += vlanes) {
+        cv::v_uint16 s0, s1;
+        cv::v_uint32 s00, s01, s10, s11;
+        cv::v_expand(cv::vx_load(s + i), s0, s1);
+        cv::v_expand(s0, s00, s01);
+        cv::v_expand(s1, s10, s11);
+
+        cv::v_int16 lo = cv::v_pack(v_glow(s00, v_blendRows(h0 + i, h1 + i, vb)),
+                v_glow(s01, v_blendRows(h0 + i + flanes, h1 + i + flanes, vb)));
+        cv::v_int16 hi = cv::v_pack(v_glow(s10, v_blendRows(h0 + i + 2 * flanes, h1 + i + 2 * flanes, vb)),
+                v_glow(s11, v_blendRows(h0 + i + 3 * flanes, h1 + i + 3 * flanes, vb)));
+        cv::v_store(d + i, cv::v_pack_u(lo, hi));
+    }
+#endif
+    for (; i < len; ++i) {
+        float blurred = h0[i] + (h1[i] - h0[i]) * b;
+        d[i] = cv::saturate_cast<uchar>(255.0f - (255.0f - s[i]) * (255.0f - blurred) / 255.0f);
+    }
+}
+
+//upscales two blurred mask rows, blends them and adds them to src with gain
+static void composeBloomRow(const float* h0, const float* h1, float b, float gain, const uchar* s, uchar* d, int len) {
+    int i = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int vlanes = cv::VTraits<cv::v_uint8>::vlanes();
+    const int flanes = cv::VTraits<cv::v_float32>::vlanes();
+    const cv::v_float32 vb = cv::vx_setall_f32(b);
+    const cv::v_float32 vgain = cv::vx_setall_f32(gain);
+    for (; i <= len - vlanes; i += vlanes) {
+        cv::v_uint16 s0, s1;
+        cv::v_uint32 s00, s01, s10, s11;
+        cv::v_expand(cv::vx_load(s + i), s0, s1);
+        cv::v_expand(s0, s00, s01);
+        cv::v_expand(s1, s10, s11);
+
+        cv::v_int16 lo = cv::v_pack(v_bloom(s00, v_blendRows(h0 + i, h1 + i, vb), vgain),
+                v_bloom(s01, v_blendRows(h0 + i + flanes, h1 + i + flanes, vb), vgain));
+        cv::v_int16 hi = cv::v_pack(v_bloom(s10, v_blendRows(h0 + i + 2 * flanes, h1 + i + 2 * flanes, vb), vgain),
+                v_bloom(s11, v_blendRows(h0 + i + 3 * flanes, h1 + i + 3 * flanes, vb), vgain));
+        cv::v_store(d + i, cv::v_pack_u(lo, hi));
+    }
+#endif
+    for (; i < len; ++i) {
+        float mask = h0[i] + (h1[i] - h0[i]) * b;
+        d[i] = cv::saturate_cast<uchar>(s[i] + mask * gain);
+    }
+}
+
+//see bloom_source
+static inline uchar bloomMask(int b, int g, int r, int thresh) {
+    int mx = std::max(std::max(b, g), r);
+    int mn = std::min(std::min(b, g), r);
+    int sum = mx + mn;
+    if (sum < 255 || mx == mn)
+        return mn > thresh ? 255 : 0;
+    return sum * (255 - mx) > thresh * (510 - sum) ? 255 : 0;
+}
+
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+//bloomMask of 16 bit max and min. all ones for pixels above thresh.
+static inline cv::v_uint16 v_bloomMask(const cv::v_uint16& mx, const cv::v_uint16& mn, const cv::v_uint16& thresh) {
+    const cv::v_uint16 v255 = cv::vx_setall_u16(255);
+    cv::v_uint16 sum = cv::v_add(mx, mn);
+    cv::v_uint32 p0, p1, q0, q1;
+    cv::v_mul_expand(sum, cv::v_sub(v255, mx), p0, p1);
+    cv::v_mul_expand(thresh, cv::v_sub(cv::vx_setall_u16(510), sum), q0, q1);
+    cv::v_uint16 bright = cv::v_pack(cv::v_gt(p0, q0), cv::v_gt(p1, q1));
+    cv::v_uint16 dark = cv::v_or(cv::v_lt(sum, v255), cv::v_eq(mx, mn));
+    return cv::v_select(dark, cv::v_gt(mn, thresh), bright);
+}
+#endif
+
+static void bloomMaskRow(const uchar* s, uchar* m, int width, int thresh) {
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int vlanes = cv::VTraits<cv::v_uint8>::vlanes();
+    const cv::v_uint16 vthresh = cv::vx_setall_u16(ushort(thresh));
+    for (; x <= width - vlanes; x += vlanes) {
+        cv::v_uint8 b, g, r, a;
+        cv::v_load_deinterleave(s + x * 4, b, g, r, a);
+        cv::v_uint16 mx0, mx1, mn0, mn1;
+        cv::v_expand(cv::v_max(cv::v_max(b, g), r), mx0, mx1);
+        cv::v_expand(cv::v_min(cv::v_min(b, g), r), mn0, mn1);
+        //all ones saturates to 255
+        cv::v_store(m + x, cv::v_pack(v_bloomMask(mx0, mn0, vthresh), v_bloomMask(mx1, mn1, vthresh)));
+    }
+#endif
+    for (; x < width; ++x)
+        m[x] = bloomMask(s[x * 4], s[x * 4 + 1], s[x * 4 + 2], thresh);
+}
+
+//thresholds the mask of src and downscales it by half (2x2 average)
+static void cpu_bloomMask(const cv::Mat& src, cv::Mat& mask, int thresh) {
+    cv::parallel_for_(cv::Range(0, mask.rows), [&](const cv::Range& range) {
+        std::vector<uchar> m0(src.cols);
+        std::vector<uchar> m1(src.cols);
+        for (int y = range.start; y < range.end; ++y) {
+            bloomMaskRow(src.ptr(2 * y), m0.data(), src.cols, thresh);
+            bloomMaskRow(src.ptr(2 * y + 1), m1.data(), src.cols, thresh);
+            uchar* d = mask.ptr(y);
+            for (int x = 0; x < mask.cols; ++x)
+                d[x] = uchar((m0[2 * x] + m0[2 * x + 1] + m1[2 * x] + m1[2 * x + 1] + 2) >> 2);
+        }
+    });
+}
+
+//upscales small bilinearly to the size of src and combines it row by row with src using composeRow.
+//a single channel small is applied to all channels of src.
+template<typename RowOp> static void cpu_compose(const cv::Mat& src, const cv::Mat& small, cv::Mat& dst, RowOp composeRow) {
+    const int cn = src.channels();
+    const int scn = small.channels();
+    const float ifx = float(small.cols) / src.cols;
+    const float ify = float(small.rows) / src.rows;
+
+    std::vector<int> xofs(src.cols * 2);
+    std::vector<float> xalpha(src.cols);
+    for (int x = 0; x < src.cols; ++x) {
+        float fx = (x + 0.5f) * ifx - 0.5f;
+        int x0 = cvFloor(fx);
+        xalpha[x] = fx - x0;
+        xofs[x * 2] = std::min(std::max(x0, 0), small.cols - 1) * scn;
+        xofs[x * 2 + 1] = std::min(std::max(x0 + 1, 0), small.cols - 1) * scn;
+    }
+
+    auto interpolateRow = [&](const uchar* s, float* h) {
+        for (int x = 0; x < src.cols; ++x) {
+            const uchar* p0 = s + xofs[x * 2];
+            const uchar* p1 = s + xofs[x * 2 + 1];
+            float a = xalpha[x];
+            for (int c = 0; c < cn; ++c) {
+                int sc = scn == 1 ? 0 : c;
+                h[x * cn + c] = p0[sc] + (p1[sc] - p0[sc]) * a;
+            }
+        }
+    };
+
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+        const int len = src.cols * cn;
+        std::vector<float> h0(len);
+        std::vector<float> h1(len);
+        //neighbouring rows mostly interpolate between the same two rows of small
+        int cached0 = -1;
+        int cached1 = -1;
+        for (int y = range.start; y < range.end; ++y) {
+            float fy = (y + 0.5f) * ify - 0.5f;
+            int y0 = cvFloor(fy);
+            float b = fy - y0;
+            int r0 = std::min(std::max(y0, 0), small.rows - 1);
+            int r1 = std::min(std::max(y0 + 1, 0), small.rows - 1);
+            if (r0 != cached0 || r1 != cached1) {
+                interpolateRow(small.ptr(r0), h0.data());
+                interpolateRow(small.ptr(r1), h1.data());
+                cached0 = r0;
+                cached1 = r1;
+            }
+            composeRow(h0.data(), h1.data(), b, src.ptr(y), dst.ptr(y), len);
+        }
+    });
+}
+
+void glow_effect(FrameArena& arena, const cv::UMat& src, cv::UMat& dst, int ksize) {
+    CV_Assert(src.depth() == CV_8U && ksize > 0);
+
+#ifndef __EMSCRIPTEN__
+    if (cv::ocl::useOpenCL() && src.channels() == 4 && ocl_glow(arena, src, dst, ksize))
+        return;
+#endif
+
+    cv::UMat blurred = arena.get(cv::Size(src.cols / 2, src.rows / 2), src.type());
+    cv::resize(src, blurred, blurred.size());
+    cv::boxFilter(blurred, blurred, -1, cv::Size(ksize, ksize), cv::Point(-1, -1), true, cv::BORDER_REPLICATE);
+
+    dst.create(src.size(), src.type());
+    cv::Mat b = blurred.getMat(cv::ACCESS_READ);
+    cv::Mat s = src.getMat(cv::ACCESS_READ);
+    cv::Mat d = dst.getMat(cv::ACCESS_WRITE);
+    cpu_compose(s, b, d, composeGlowRow);
+}
+
+void bloom_effect(FrameArena& arena, const cv::UMat& src, cv::UMat& dst, int ksize, int threshValue, float gain) {
+    CV_Assert(src.type() == CV_8UC4 && ksize > 0 && threshValue >= 0 && threshValue <= 255);
+    //the mask is blurred at half resolution, so half the kernel covers the same area
+    int halfKsize = std::max(ksize / 2, 1);
+
+#ifndef __EMSCRIPTEN__
+    if (cv::ocl::useOpenCL() && ocl_bloom(arena, src, dst, halfKsize, threshValue, gain))
+        return;
+#endif
+
+    cv::Size half(src.cols / 2, src.rows / 2);
+    cv::UMat mask = arena.get(half, CV_8UC1);
+    cv::UMat blurred = arena.get(half, CV_8UC1);
+    {
+        cv::Mat s = src.getMat(cv::ACCESS_READ);
+        cv::Mat m = mask.getMat(cv::ACCESS_WRITE);
+        cpu_bloomMask(s, m, threshValue);
+    }
+    cv::boxFilter(mask, blurred, -1, cv::Size(halfKsize, halfKsize), cv::Point(-1, -1), true, cv::BORDER_REPLICATE);
+
+    dst.create(src.size(), src.type());
+    cv::Mat b = blurred.getMat(cv::ACCESS_READ);
+    cv::Mat s = src.getMat(cv::ACCESS_READ);
+    cv::Mat d = dst.getMat(cv::ACCESS_WRITE);
+    cpu_compose(s, b, d, [gain](const float* h0, const float* h1, float by, const uchar* srow, uchar* drow, int len) {
+        composeBloomRow(h0, h1, by, gain, srow, drow, len);
+    });
+}
+
+void prepare_background(FrameArena& arena, cv::UMat& background, BackgroundModes bgMode) {
+    cv::UMat tmp = arena.get(background.size(), CV_8UC3);
+    cv::UMat backgroundGrey = arena.get(background.size(), CV_8UC1);
+    std::vector<cv::UMat> channels = { arena.get(background.size(), CV_8UC1), arena.get(background.size(), CV_8UC1), arena.get(background.size(), CV_8UC1) };
+
+    switch (bgMode) {
+    case GREY:
+        cv::cvtColor(background, backgroundGrey, cv::COLOR_BGRA2GRAY);
+        cv::cvtColor(backgroundGrey, background, cv::COLOR_GRAY2BGRA);
+        break;
+    case VALUE:
+        cv::cvtColor(background, tmp, cv::COLOR_BGRA2BGR);
+        cv::cvtColor(tmp, tmp, cv::COLOR_BGR2HSV);
+        split(tmp, channels);
+        cv::cvtColor(channels[2], background, cv::COLOR_GRAY2BGRA);
+        break;
+    case COLOR:
+        cv::cvtColor(background, background, cv::COLOR_BGRA2RGBA);
+        break;
+    case BLACK:
+        background = cv::Scalar::all(0);
+        break;
+    default:
+        break;
+    }
+}
+
+void composite_layers(FrameArena& arena, const cv::UMat& background, const cv::UMat& foreground, const cv::UMat& frameBuffer, cv::UMat& dst, int kernelSize, float fgLossPercent, PostProcModes ppMode, int bloomThresh, float bloomGain) {
+    cv::UMat post = arena.get(foreground.size(), foreground.type());
+
+    cv::subtract(foreground, cv::Scalar::all(255.0f * (fgLossPercent / 100.0f)), foreground);
+    cv::add(foreground, frameBuffer, foreground);
+
+    switch (ppMode) {
+    case GLOW:
+        glow_effect(arena, foreground, post, kernelSize);
+        break;
+    case BLOOM:
+        bloom_effect(arena, foreground, post, kernelSize, bloomThresh, bloomGain);
+        break;
+    case NONE:
+        foreground.copyTo(post);
+        break;
+    default:
+        break;
+    }
+
+    cv::add(background, post, dst);
+}
+
+void composite_layers_blur(FrameArena& arena, const cv::UMat& background, const cv::UMat& foreground, const cv::UMat& frameBuffer, cv::UMat& dst, int blurKernelSize, float fgLossPercent) {
+    cv::UMat blur = arena.get(foreground.size(), foreground.type());
+
+    cv::subtract(foreground, cv::Scalar::all(255.0f * (fgLossPercent / 100.0f)), foreground);
+    cv::add(foreground, frameBuffer, foreground);
+    cv::boxFilter(foreground, blur, -1, cv::Size(blurKernelSize, blurKernelSize), cv::Point(-1,-1), true, cv::BORDER_REPLICATE);
+    cv::add(background, blur, dst);
+}
+
+void reduce_shadows(FrameArena& arena, const cv::UMat& srcBGR, cv::UMat& dstBGR, double to_percent) {
+    assert(srcBGR.type() == CV_8UC3);
+    cv::UMat hsv = arena.get(srcBGR.size(), CV_8UC3);
+    std::vector<cv::UMat> hsvChannels = { arena.get(srcBGR.size(), CV_8UC1), arena.get(srcBGR.size(), CV_8UC1), arena.get(srcBGR.size(), CV_8UC1) };
+    cv::UMat valueFloat = arena.get(srcBGR.size(), CV_32FC1);
+
+    cvtColor(srcBGR, hsv, cv::COLOR_BGR2HSV);
+    cv::split(hsv, hsvChannels);
+    hsvChannels[2].convertTo(valueFloat, CV_32F, 1.0 / 255.0);
+
+    double minIn, maxIn;
+    cv::minMaxLoc(valueFloat, &minIn, &maxIn);
+    cv::subtract(valueFloat, minIn, valueFloat);
+    cv::divide(valueFloat, cv::Scalar::all(maxIn - minIn), valueFloat);
+    double minOut = (minIn + (1.0 * (to_percent / 100.0)));
+    cv::multiply(valueFloat, cv::Scalar::all(1.0 - minOut), valueFloat);
+    cv::add(valueFloat, cv::Scalar::all(minOut), valueFloat);
+
+    valueFloat.convertTo(hsvChannels[2], CV_8U, 255.0);
+    cv::merge(hsvChannels, hsv);
+    cvtColor(hsv, dstBGR, cv::COLOR_HSV2BGR);
+}
+
+void unsharp_mask(FrameArena& arena, const cv::UMat& src, cv::UMat& dst, const float strength) {
+    cv::UMat blurred = arena.get(src.size(), src.type());
+    cv::UMat laplacian = arena.get(src.size(), CV_MAKETYPE(CV_8U, src.channels()));
+    cv::medianBlur(src, blurred, 3);
+    cv::Laplacian(blurred, laplacian, CV_8U);
+    cv::multiply(laplacian, cv::Scalar::all(strength), laplacian);
+    cv::subtract(src, laplacian, dst);
+}
+} /* namespace viz2d */
+} /* namespace kb */
@@ -0,0 +1,53 @@
+#ifndef SRC_COMMON_EFFECTS_HPP_
+#define SRC_COMMON_EFFECTS_HPP_
+
+#include <opencv2/core.hpp>
+
+namespace kb {
+namespace viz2d {
+class FrameArena;
+
+enum BackgroundModes {
+    GREY,
+    COLOR,
+    VALUE,
+    BLACK
+};
+
+enum PostProcModes {
+    GLOW,
+    BLOOM,
+    NONE
+};
+
+/*!
+ * Multiplies the inverted image with a blurred version of itself and inverts the result, which makes bright areas glow.
+ * The blur is a box filter of ksize on the image downscaled by half. Same result as the bitwise_not, resize, boxFilter,
+ * resize, multiply, divide, bitwise_not chain of the demos (off by one at most), but in three OpenCL kernels respectively
+ * one vectorized full resolution pass on the CPU. src and dst may be the same.
+ */
+void glow_effect(FrameArena& arena, const cv::UMat& src, cv::UMat& dst, int ksize);
+
+/*!
+ * Adds a blurred mask of the pixels whose HLS lightness * (1 - saturation) exceeds threshValue to the BGRA image src,
+ * multiplied by gain. The mask is thresholded directly from BGRA while downscaling by half and blurred at that size
+ * with a box filter of about ksize full resolution pixels. Same thresholding as the cvtColor, split, multiply, threshold
+ * chain of the optflow demo, at a fraction of the memory traffic. src and dst may be the same.
+ */
+void bloom_effect(FrameArena& arena, const cv::UMat& src, cv::UMat& dst, int ksize = 3, int threshValue = 235, float gain = 4);
+
+//converts the BGRA background in place according to bgMode
+void prepare_background(FrameArena& arena, cv::UMat& background, BackgroundModes bgMode);
+//fades foreground by fgLossPercent, adds frameBuffer to it, post processes it with ppMode and adds background. the
+//bloom parameters are only used by BLOOM.
+void composite_layers(FrameArena& arena, const cv::UMat& background, const cv::UMat& foreground, const cv::UMat& frameBuffer, cv::UMat& dst, int kernelSize, float fgLossPercent, PostProcModes ppMode, int bloomThresh = 210, float bloomGain = 3);
+//like composite_layers but the post processing is a box blur of blurKernelSize
+void composite_layers_blur(FrameArena& arena, const cv::UMat& background, const cv::UMat& foreground, const cv::UMat& frameBuffer, cv::UMat& dst, int blurKernelSize, float fgLossPercent);
+//stretches the value of the BGR image srcBGR so it starts at to_percent
+void reduce_shadows(FrameArena& arena, const cv::UMat& srcBGR, cv::UMat& dstBGR, double to_percent);
+//subtracts the laplacian of the median blurred src multiplied by strength
+void unsharp_mask(FrameArena& arena, const cv::UMat& src, cv::UMat& dst, const float strength);
+} /* namespace viz2d */
+} /* namespace kb */
+
+#endif /* SRC_COMMON_EFFECTS_HPP_ */
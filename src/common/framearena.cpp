@@ -0,0 +1,89 @@
+#include "framearena.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace kb {
+namespace viz2d {
+
+cv::UMat FrameArena::get(const cv::Size& sz, int type) {
+    assert(sz.area() > 0);
+    std::lock_guard<std::mutex> lock(mtx_);
+    Bucket& b = buckets_[std::make_tuple(sz.width, sz.height, type)];
+    if (b.used_ == b.bufs_.size()) {
+        b.bufs_.emplace_back(sz, type);
+        ++allocations_;
+    }
+
+    cv::UMat& buf = b.bufs_[b.used_++];
+    bytesInUse_ += buf.total() * buf.elemSize();
+    return buf;
+}
+
+void FrameArena::release(const cv::UMat& buf) {
+    if (buf.empty())
+        return;
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = buckets_.find(std::make_tuple(buf.cols, buf.rows, buf.type()));
+    if (it == buckets_.end())
+        return;
+
+    //the buffers in use are the first used_ ones. move it behind them.
+    Bucket& b = it->second;
+    for (size_t i = 0; i < b.used_; ++i) {
+        if (b.bufs_[i].u == buf.u) {
+            b.peak_ = std::max(b.peak_, b.used_);
+            std::swap(b.bufs_[i], b.bufs_[--b.used_]);
+            highWaterMark_ = std::max(highWaterMark_, bytesInUse_);
+            bytesInUse_ -= buf.total() * buf.elemSize();
+            return;
+        }
+    }
+}
+
+void FrameArena::recycle() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    ++frames_;
+    highWaterMark_ = std::max(highWaterMark_, bytesInUse_);
+    bytesInUse_ = 0;
+
+    for (auto& p : buckets_) {
+        Bucket& b = p.second;
+        //somebody kept a reference beyond the frame. hand it over and forget about it.
+        for (auto it = b.bufs_.begin(); it != b.bufs_.end();) {
+            if (it->u && it->u->urefcount > 1)
+                it = b.bufs_.erase(it);
+            else
+                ++it;
+        }
+
+        b.peak_ = std::max(b.peak_, b.used_);
+        b.used_ = 0;
+        if (frames_ % TRIM_INTERVAL == 0) {
+            b.bufs_.resize(std::min(b.bufs_.size(), b.peak_));
+            b.peak_ = 0;
+        }
+    }
+}
+
+size_t FrameArena::getHighWaterMark() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return highWaterMark_;
+}
+
+size_t FrameArena::getBytes() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    size_t bytes = 0;
+    for (auto& p : buckets_) {
+        for (auto& buf : p.second.bufs_)
+            bytes += buf.total() * buf.elemSize();
+    }
+    return bytes;
+}
+
+size_t FrameArena::getAllocations() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return allocations_;
+}
+}
+}
@@ -0,0 +1,50 @@
+#ifndef SRC_COMMON_FRAMEARENA_HPP_
+#define SRC_COMMON_FRAMEARENA_HPP_
+
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+#include <opencv2/core.hpp>
+
+namespace kb {
+namespace viz2d {
+
+/*!
+ * Scratch buffers for temporaries that only live during one frame. get() hands out buffers keyed by size and type and
+ * recycle() (called by Viz2D::display()) makes them available again. As long as a frame requests the same temporaries as
+ * the one before, no allocations happen. Buffers that weren't needed for a while are freed, so memory stays bounded.
+ */
+class FrameArena {
+    //frames after which buffers that weren't needed are freed
+    static constexpr size_t TRIM_INTERVAL = 120;
+
+    struct Bucket {
+        std::vector<cv::UMat> bufs_;
+        size_t used_ = 0;
+        size_t peak_ = 0;
+    };
+
+    std::map<std::tuple<int, int, int>, Bucket> buckets_;
+    std::mutex mtx_;
+    size_t frames_ = 0;
+    size_t bytesInUse_ = 0;
+    size_t highWaterMark_ = 0;
+    size_t allocations_ = 0;
+public:
+    //the returned buffer must not be kept beyond the current frame
+    cv::UMat get(const cv::Size& sz, int type);
+    //hands a buffer from get() back before the end of the frame, so a later get() of this frame can reuse it. buf must not
+    //be used afterwards.
+    void release(const cv::UMat& buf);
+    void recycle();
+    //the most bytes handed out during a single frame
+    size_t getHighWaterMark();
+    //the bytes currently held by the arena
+    size_t getBytes();
+    size_t getAllocations();
+};
+}
+}
+
+#endif /* SRC_COMMON_FRAMEARENA_HPP_ */
@@ -0,0 +1,247 @@
+#include "framebus.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace kb {
+namespace viz2d {
+
+static constexpr char MAGIC[8] = { 'G', 'C', 'V', 'F', 'B', 'U', 'S', '\0' };
+static constexpr uint64_t BUS_PAGE_SIZE = 4096;
+static constexpr uint64_t CACHE_LINE = 64;
+
+static uint64_t align_to(uint64_t n, uint64_t alignment) {
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+//shm_open() wants a leading slash
+static std::string shm_name(const std::string& name) {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+static FrameBusSlot& slot_at(uchar* map, const FrameBusHeader* header, uint64_t frame) {
+    return *reinterpret_cast<FrameBusSlot*>(map + align_to(sizeof(FrameBusHeader), BUS_PAGE_SIZE) + (frame % header->slotCount_) * header->slotSize_);
+}
+
+static uchar* frame_data(FrameBusSlot& slot) {
+    return reinterpret_cast<uchar*>(&slot) + CACHE_LINE;
+}
+
+//a bus may be replaced once its publisher closed it or is gone. anything that isn't a bus of this version is replaced too.
+static bool is_replaceable(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return errno == ENOENT;
+
+    bool replaceable = true;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(FrameBusHeader)) {
+        void* map = mmap(nullptr, sizeof(FrameBusHeader), PROT_READ, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            const FrameBusHeader* header = static_cast<const FrameBusHeader*>(map);
+            if (memcmp(header->magic_, MAGIC, sizeof(MAGIC)) == 0 && header->version_ == FrameBusHeader::VERSION
+                    && !header->closed_.load(std::memory_order_acquire) && (kill(header->pid_, 0) == 0 || errno == EPERM))
+                replaceable = false;
+            munmap(map, sizeof(FrameBusHeader));
+        }
+    }
+    ::close(fd);
+    return replaceable;
+}
+
+//the header comes from another process. check everything slot_at() and the frame size of read() rely on.
+static bool is_valid(const FrameBusHeader* header, uint64_t mapSize) {
+    if (memcmp(header->magic_, MAGIC, sizeof(MAGIC)) != 0 || header->version_ != FrameBusHeader::VERSION)
+        return false;
+    if (header->width_ <= 0 || header->height_ <= 0 || header->type_ != CV_MAT_TYPE(header->type_) || header->slotCount_ < 2)
+        return false;
+    if (header->frameBytes_ != uint64_t(header->width_) * uint64_t(header->height_) * CV_ELEM_SIZE(header->type_)
+            || CACHE_LINE + header->frameBytes_ > header->slotSize_)
+        return false;
+    uint64_t offset = align_to(sizeof(FrameBusHeader), BUS_PAGE_SIZE);
+    //checked step by step so that the product can't overflow
+    return offset <= mapSize && header->slotSize_ <= (mapSize - offset) / header->slotCount_;
+}
+
+FrameBusPublisher::FrameBusPublisher(const std::string& name, const cv::Size& size, int type, float fps, size_t slots) :
+        name_(shm_name(name)) {
+    uint64_t frameBytes = size.area() * CV_ELEM_SIZE(type);
+    uint64_t slotSize = align_to(CACHE_LINE + frameBytes, BUS_PAGE_SIZE);
+    slots = std::max(slots, size_t(2));
+
+    fd_ = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd_ < 0 && errno == EEXIST) {
+        if (!is_replaceable(name_)) {
+            std::cerr << "Frame bus is in use by another publisher: " << name_ << std::endl;
+            return;
+        }
+        std::cerr << "Replacing stale frame bus: " << name_ << std::endl;
+        shm_unlink(name_.c_str());
+        fd_ = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    }
+    mapSize_ = align_to(sizeof(FrameBusHeader), BUS_PAGE_SIZE) + slots * slotSize;
+    if (fd_ < 0 || ftruncate(fd_, mapSize_) != 0) {
+        std::cerr << "Unable to create frame bus: " << name_ << std::endl;
+        return;
+    }
+
+    void* map = mmap(nullptr, mapSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) {
+        std::cerr << "Unable to map frame bus: " << name_ << std::endl;
+        return;
+    }
+    map_ = static_cast<uchar*>(map);
+    //the mapping is zero filled, so all slots and counters start at 0
+    header_ = new (map_) FrameBusHeader();
+    header_->version_ = FrameBusHeader::VERSION;
+    header_->width_ = size.width;
+    header_->height_ = size.height;
+    header_->type_ = type;
+    header_->fps_ = fps;
+    header_->slotCount_ = slots;
+    header_->frameBytes_ = frameBytes;
+    header_->slotSize_ = slotSize;
+    header_->pid_ = getpid();
+    //consumers only accept the bus once the magic is there
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header_->magic_, MAGIC, sizeof(MAGIC));
+}
+
+FrameBusPublisher::~FrameBusPublisher() {
+    if (header_)
+        header_->closed_.store(1, std::memory_order_release);
+    if (map_)
+        munmap(map_, mapSize_);
+    if (fd_ >= 0) {
+        ::close(fd_);
+        //consumers that are attached keep their mapping
+        shm_unlink(name_.c_str());
+    }
+}
+
+bool FrameBusPublisher::publish(cv::InputArray frame) {
+    if (!isOpened() || frame.size() != cv::Size(header_->width_, header_->height_) || frame.type() != header_->type_)
+        return false;
+
+    uint64_t n = header_->published_.load(std::memory_order_relaxed);
+    FrameBusSlot& slot = slot_at(map_, header_, n);
+    slot.seq_.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    cv::Mat dst(header_->height_, header_->width_, header_->type_, frame_data(slot));
+    frame.copyTo(dst);
+    slot.seq_.store(2 * n + 2, std::memory_order_release);
+    header_->published_.store(n + 1, std::memory_order_release);
+    return true;
+}
+
+bool FrameBusPublisher::isOpened() {
+    return header_ != nullptr;
+}
+
+uint64_t FrameBusPublisher::getPublished() {
+    return header_ ? header_->published_.load(std::memory_order_relaxed) : 0;
+}
+
+FrameBusSource::FrameBusSource(const std::string& name, std::chrono::milliseconds timeout) :
+        timeout_(timeout) {
+    std::string shmName = shm_name(name);
+    fd_ = shm_open(shmName.c_str(), O_RDONLY, 0);
+    struct stat st;
+    if (fd_ < 0 || fstat(fd_, &st) != 0 || size_t(st.st_size) < sizeof(FrameBusHeader)) {
+        std::cerr << "Unable to open frame bus: " << shmName << std::endl;
+        return;
+    }
+
+    mapSize_ = st.st_size;
+    void* map = mmap(nullptr, mapSize_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) {
+        std::cerr << "Unable to map frame bus: " << shmName << std::endl;
+        return;
+    }
+    map_ = static_cast<uchar*>(map);
+    FrameBusHeader* header = reinterpret_cast<FrameBusHeader*>(map_);
+    if (!is_valid(header, mapSize_)) {
+        std::cerr << "Invalid frame bus: " << shmName << std::endl;
+        munmap(map_, mapSize_);
+        map_ = nullptr;
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    header_ = header;
+
+    //start with the newest frame
+    uint64_t published = header_->published_.load(std::memory_order_acquire);
+    next_ = published > 0 ? published - 1 : 0;
+}
+
+FrameBusSource::~FrameBusSource() {
+    if (map_)
+        munmap(map_, mapSize_);
+    if (fd_ >= 0)
+        ::close(fd_);
+}
+
+bool FrameBusSource::read(cv::UMat& frame) {
+    if (!isOpened()) {
+        frame.release();
+        return false;
+    }
+
+    auto lastFrame = std::chrono::steady_clock::now();
+    while (true) {
+        uint64_t published = header_->published_.load(std::memory_order_acquire);
+        if (published > next_) {
+            //the oldest frame that can't be overwritten during the copy is one slot behind the writer
+            if (published - next_ >= header_->slotCount_) {
+                dropped_ += published - 1 - next_;
+                next_ = published - 1;
+            }
+
+            FrameBusSlot& slot = slot_at(map_, header_, next_);
+            uint64_t seq = slot.seq_.load(std::memory_order_acquire);
+            if (seq == 2 * next_ + 2) {
+                cv::Mat(header_->height_, header_->width_, header_->type_, frame_data(slot)).copyTo(frame);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.seq_.load(std::memory_order_relaxed) == seq) {
+                    ++next_;
+                    return true;
+                }
+            }
+            //overwritten while reading. try again with a newer frame.
+            continue;
+        }
+
+        if (header_->closed_.load(std::memory_order_acquire) || std::chrono::steady_clock::now() - lastFrame > timeout_) {
+            frame.release();
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+cv::Size FrameBusSource::getSize() {
+    return header_ ? cv::Size(header_->width_, header_->height_) : cv::Size();
+}
+
+float FrameBusSource::getFPS() {
+    return header_ ? header_->fps_ : 0;
+}
+
+bool FrameBusSource::isOpened() {
+    return header_ != nullptr;
+}
+
+uint64_t FrameBusSource::getDropped() {
+    return dropped_;
+}
+} /* namespace viz2d */
+} /* namespace kb */
@@ -0,0 +1,90 @@
+#ifndef SRC_COMMON_FRAMEBUS_HPP_
+#define SRC_COMMON_FRAMEBUS_HPP_
+
+#include "source.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace kb {
+namespace viz2d {
+
+/*!
+ * The layout of a frame bus in shared memory: this header, padded to a page, followed by slotCount_ slots of slotSize_
+ * bytes. Every slot starts with a FrameBusSlot and the frame follows at the next cache line.
+ */
+struct FrameBusHeader {
+    static constexpr uint32_t VERSION = 2;
+
+    char magic_[8];
+    uint32_t version_;
+    int32_t width_;
+    int32_t height_;
+    int32_t type_;
+    float fps_;
+    uint32_t slotCount_;
+    uint64_t frameBytes_;
+    uint64_t slotSize_;
+    //the process of the publisher, to tell a live bus from the leftover of a crashed publisher
+    int64_t pid_;
+    //number of frames published so far
+    std::atomic<uint64_t> published_;
+    std::atomic<uint32_t> closed_;
+};
+
+struct FrameBusSlot {
+    //a seqlock: 2 * frame + 1 while frame is being written, 2 * frame + 2 once it is complete
+    std::atomic<uint64_t> seq_;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the frame bus needs lock-free 64-bit atomics");
+
+/*!
+ * Publishes frames into a ring in POSIX shared memory, so one decoder can feed pipelines in other processes. The
+ * publisher never waits for consumers: slow consumers skip frames. The bus is removed when the publisher is destroyed.
+ * An existing bus of the same name is only replaced if it was closed or its publisher is gone.
+ */
+class FrameBusPublisher {
+    std::string name_;
+    int fd_ = -1;
+    uchar* map_ = nullptr;
+    size_t mapSize_ = 0;
+    FrameBusHeader* header_ = nullptr;
+public:
+    FrameBusPublisher(const std::string& name, const cv::Size& size, int type, float fps, size_t slots = 4);
+    virtual ~FrameBusPublisher();
+    //frame has to be of the size and type of the bus
+    bool publish(cv::InputArray frame);
+    bool isOpened();
+    uint64_t getPublished();
+};
+
+/*!
+ * Reads the frames of a bus created by a FrameBusPublisher, starting with the newest. Frames are copied straight from
+ * the shared mapping into the capture UMat. read() waits for the next frame and reports the end of the stream when the
+ * publisher is gone or hasn't published anything for the timeout.
+ */
+class FrameBusSource : public Source {
+    int fd_ = -1;
+    uchar* map_ = nullptr;
+    size_t mapSize_ = 0;
+    FrameBusHeader* header_ = nullptr;
+    uint64_t next_ = 0;
+    uint64_t dropped_ = 0;
+    std::chrono::milliseconds timeout_;
+public:
+    FrameBusSource(const std::string& name, std::chrono::milliseconds timeout = std::chrono::milliseconds(5000));
+    virtual ~FrameBusSource();
+    bool read(cv::UMat& frame) override;
+    cv::Size getSize() override;
+    float getFPS() override;
+    bool isOpened() override;
+    //frames that were overwritten before this consumer got to them
+    uint64_t getDropped();
+};
+} /* namespace viz2d */
+} /* namespace kb */
+
+#endif /* SRC_COMMON_FRAMEBUS_HPP_ */
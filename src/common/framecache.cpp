@@ -0,0 +1,229 @@
+#include "framecache.hpp"
+
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <opencv2/videoio.hpp>
+
+namespace kb {
+namespace viz2d {
+
+static constexpr char MAGIC[8] = { 'G', 'C', 'V', 'C', 'A', 'C', 'H', 'E' };
+static constexpr uint64_t CACHE_PAGE_SIZE = 4096;
+
+static uint64_t align_to_page(uint64_t n) {
+    return (n + CACHE_PAGE_SIZE - 1) / CACHE_PAGE_SIZE * CACHE_PAGE_SIZE;
+}
+
+static bool is_valid(const FrameCacheHeader& header) {
+    return memcmp(header.magic_, MAGIC, sizeof(MAGIC)) == 0 && header.version_ == FrameCacheHeader::VERSION;
+}
+
+bool make_frame_cache(const std::string& input, const std::string& cacheFile, bool compress) {
+    struct stat st;
+    if (stat(input.c_str(), &st) != 0) {
+        std::cerr << "Unable to stat: " << input << std::endl;
+        return false;
+    }
+
+    FrameCacheHeader header;
+    {
+        std::ifstream ifs(cacheFile, std::ios::binary);
+        if (ifs.read(reinterpret_cast<char*>(&header), sizeof(header)) && is_valid(header) && header.sourceSize_ == uint64_t(st.st_size)
+                && header.sourceMTime_ == int64_t(st.st_mtime) && bool(header.flags_ & FrameCacheHeader::COMPRESSED) == compress)
+            return true;
+    }
+
+    cv::VideoCapture capture(input, cv::CAP_FFMPEG);
+    if (!capture.isOpened()) {
+        std::cerr << "Unable to open: " << input << std::endl;
+        return false;
+    }
+
+    //written under a temporary name, so an interrupted run doesn't leave a truncated cache behind
+    std::string tmpFile = cacheFile + ".tmp";
+    std::ofstream ofs(tmpFile, std::ios::binary | std::ios::trunc);
+    if (!ofs) {
+        std::cerr << "Unable to create: " << tmpFile << std::endl;
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic_, MAGIC, sizeof(MAGIC));
+    header.version_ = FrameCacheHeader::VERSION;
+    header.flags_ = compress ? FrameCacheHeader::COMPRESSED : 0;
+    header.fps_ = capture.get(cv::CAP_PROP_FPS);
+    header.sourceSize_ = st.st_size;
+    header.sourceMTime_ = st.st_mtime;
+    header.dataOffset_ = align_to_page(sizeof(header));
+
+    std::vector<char> zeros(header.dataOffset_, 0);
+    ofs.write(zeros.data(), zeros.size());
+
+    cv::Mat frame;
+    std::vector<uint64_t> index;
+    std::vector<Bytef> packed;
+    uint64_t offset = header.dataOffset_;
+    while (capture.read(frame) && !frame.empty()) {
+        size_t bytes = frame.total() * frame.elemSize();
+        if (header.frames_ == 0) {
+            header.width_ = frame.cols;
+            header.height_ = frame.rows;
+            header.type_ = frame.type();
+            header.stride_ = compress ? 0 : align_to_page(bytes);
+            //pads every frame to the stride
+            zeros.assign(compress ? 0 : header.stride_ - bytes, 0);
+        } else if (frame.cols != header.width_ || frame.rows != header.height_ || frame.type() != header.type_) {
+            std::cerr << "Frame size changed in: " << input << std::endl;
+            break;
+        }
+        CV_Assert(frame.isContinuous());
+
+        if (compress) {
+            uLongf len = compressBound(bytes);
+            packed.resize(len);
+            if (compress2(packed.data(), &len, frame.data, bytes, Z_BEST_SPEED) != Z_OK) {
+                std::cerr << "Compression failed" << std::endl;
+                ofs.close();
+                std::remove(tmpFile.c_str());
+                return false;
+            }
+            ofs.write(reinterpret_cast<const char*>(packed.data()), len);
+            index.push_back(offset);
+            index.push_back(len);
+            offset += len;
+        } else {
+            ofs.write(reinterpret_cast<const char*>(frame.data), bytes);
+            ofs.write(zeros.data(), zeros.size());
+            offset += header.stride_;
+        }
+        ++header.frames_;
+    }
+
+    if (compress) {
+        header.indexOffset_ = offset;
+        ofs.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(uint64_t));
+    }
+    ofs.seekp(0);
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.close();
+    if (!ofs || std::rename(tmpFile.c_str(), cacheFile.c_str()) != 0) {
+        std::cerr << "Unable to write: " << cacheFile << std::endl;
+        std::remove(tmpFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+FrameCacheSource::FrameCacheSource(const std::string& cacheFile) {
+    memset(&header_, 0, sizeof(header_));
+    fd_ = ::open(cacheFile.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd_ < 0 || fstat(fd_, &st) != 0 || size_t(st.st_size) < sizeof(header_)) {
+        std::cerr << "Unable to open frame cache: " << cacheFile << std::endl;
+        return;
+    }
+
+    mapSize_ = st.st_size;
+    void* map = mmap(nullptr, mapSize_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) {
+        std::cerr << "Unable to map frame cache: " << cacheFile << std::endl;
+        return;
+    }
+    map_ = static_cast<uchar*>(map);
+    memcpy(&header_, map_, sizeof(header_));
+
+    if (!is_valid(header_) || !readIndex()) {
+        std::cerr << "Invalid frame cache: " << cacheFile << std::endl;
+        munmap(map_, mapSize_);
+        map_ = nullptr;
+        return;
+    }
+    madvise(map_, mapSize_, MADV_SEQUENTIAL);
+}
+
+bool FrameCacheSource::readIndex() {
+    if (header_.frames_ == 0)
+        return true;
+    if (header_.width_ <= 0 || header_.height_ <= 0 || header_.dataOffset_ > mapSize_)
+        return false;
+    //the divisions keep a corrupt header from overflowing the checks
+    if (!(header_.flags_ & FrameCacheHeader::COMPRESSED)) {
+        uint64_t bytes = uint64_t(header_.width_) * header_.height_ * CV_ELEM_SIZE(header_.type_);
+        return header_.stride_ >= bytes && header_.frames_ <= (mapSize_ - header_.dataOffset_) / header_.stride_;
+    }
+
+    if (header_.indexOffset_ < header_.dataOffset_ || header_.indexOffset_ > mapSize_ || header_.frames_ > (mapSize_ - header_.indexOffset_) / (2 * sizeof(uint64_t)))
+        return false;
+    //copied, the index isn't necessarily aligned in the file
+    index_.resize(header_.frames_ * 2);
+    memcpy(index_.data(), map_ + header_.indexOffset_, index_.size() * sizeof(uint64_t));
+    for (size_t i = 0; i < index_.size(); i += 2) {
+        if (index_[i] < header_.dataOffset_ || index_[i] > header_.indexOffset_ || index_[i + 1] > header_.indexOffset_ - index_[i])
+            return false;
+    }
+    return true;
+}
+
+FrameCacheSource::~FrameCacheSource() {
+    if (map_)
+        munmap(map_, mapSize_);
+    if (fd_ >= 0)
+        ::close(fd_);
+}
+
+void FrameCacheSource::setLoop(bool l) {
+    loop_ = l;
+}
+
+bool FrameCacheSource::read(cv::UMat& frame) {
+    if (!isOpened() || (next_ >= header_.frames_ && (!loop_ || header_.frames_ == 0))) {
+        frame.release();
+        return false;
+    }
+    if (next_ >= header_.frames_)
+        next_ = 0;
+
+    size_t i = next_++;
+    if (!index_.empty()) {
+        decompressed_.create(header_.height_, header_.width_, header_.type_);
+        uLongf len = decompressed_.total() * decompressed_.elemSize();
+        if (uncompress(decompressed_.data, &len, map_ + index_[i * 2], index_[i * 2 + 1]) != Z_OK) {
+            std::cerr << "Corrupt frame in frame cache: " << i << std::endl;
+            frame.release();
+            return false;
+        }
+        decompressed_.copyTo(frame);
+    } else {
+        uchar* data = map_ + header_.dataOffset_ + i * header_.stride_;
+        //fault in the next frame while this one is uploaded
+        if (next_ < header_.frames_)
+            madvise(data + header_.stride_, header_.stride_, MADV_WILLNEED);
+        cv::Mat(header_.height_, header_.width_, header_.type_, data).copyTo(frame);
+    }
+    return true;
+}
+
+cv::Size FrameCacheSource::getSize() {
+    return cv::Size(header_.width_, header_.height_);
+}
+
+float FrameCacheSource::getFPS() {
+    return header_.fps_;
+}
+
+bool FrameCacheSource::isOpened() {
+    return map_ != nullptr;
+}
+
+size_t FrameCacheSource::getFrameCount() {
+    return header_.frames_;
+}
+} /* namespace viz2d */
+} /* namespace kb */
@@ -0,0 +1,74 @@
+#ifndef SRC_COMMON_FRAMECACHE_HPP_
+#define SRC_COMMON_FRAMECACHE_HPP_
+
+#include "source.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace kb {
+namespace viz2d {
+
+/*!
+ * The file layout of a frame cache: this header, padded to a page, followed by the frames. Uncompressed frames are
+ * stored at a fixed, page aligned stride. Compressed frames are stored back to back and found through an index of
+ * (offset, size) pairs at indexOffset_.
+ */
+struct FrameCacheHeader {
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t COMPRESSED = 1;
+
+    char magic_[8];
+    uint32_t version_;
+    uint32_t flags_;
+    int32_t width_;
+    int32_t height_;
+    int32_t type_;
+    float fps_;
+    uint64_t frames_;
+    uint64_t stride_;
+    uint64_t dataOffset_;
+    uint64_t indexOffset_;
+    //to detect a changed input
+    uint64_t sourceSize_;
+    int64_t sourceMTime_;
+};
+
+/*!
+ * Decodes input once into cacheFile, unless cacheFile already holds the frames of the current version of input.
+ * Compression (zlib at its fastest level) makes the cache smaller but reading it costs a decompression per frame.
+ */
+bool make_frame_cache(const std::string& input, const std::string& cacheFile, bool compress = false);
+
+/*!
+ * Reads the frames of a cache file written by make_frame_cache(). The file is mapped into memory, so uncompressed frames
+ * are read straight from the page cache without any read() calls or intermediate buffers.
+ */
+class FrameCacheSource : public Source {
+    int fd_ = -1;
+    uchar* map_ = nullptr;
+    size_t mapSize_ = 0;
+    FrameCacheHeader header_;
+    std::vector<uint64_t> index_;
+    size_t next_ = 0;
+    bool loop_ = false;
+    cv::Mat decompressed_;
+
+    //checks that every frame lies within the file and copies the index of a compressed cache
+    bool readIndex();
+public:
+    FrameCacheSource(const std::string& cacheFile);
+    virtual ~FrameCacheSource();
+    //starts over at the first frame at the end of the cache
+    void setLoop(bool l);
+    bool read(cv::UMat& frame) override;
+    cv::Size getSize() override;
+    float getFPS() override;
+    bool isOpened() override;
+    size_t getFrameCount();
+};
+} /* namespace viz2d */
+} /* namespace kb */
+
+#endif /* SRC_COMMON_FRAMECACHE_HPP_ */
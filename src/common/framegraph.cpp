@@ -0,0 +1,345 @@
+#include "framegraph.hpp"
+#include "viz2d.hpp"
+#include "functionpool.hpp"
+#include "tracer.hpp"
+#include "qualitycontroller.hpp"
+#include "framearena.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+
+namespace kb {
+namespace viz2d {
+
+//graphs use instance indices of their own, apart from the ones the demos pass to buf()
+static std::atomic<size_t> next_instance = 1 << 16;
+
+FrameGraph::FrameGraph(Viz2D& v2d) : v2d_(v2d), instance_(next_instance++) {
+}
+
+FrameGraph::~FrameGraph() {
+    try {
+        finish();
+    } catch (std::exception& ex) {
+        cerr << ex.what() << endl;
+    }
+}
+
+FrameGraph::Stage& FrameGraph::add(const std::string& name, StageKind kind, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs) {
+    //stages might be moved around by the vector
+    finish();
+    Stage& s = stages_.emplace_back();
+    s.name_ = name;
+    s.kind_ = kind;
+    s.inputs_.insert(inputs.begin(), inputs.end());
+    s.outputs_.insert(outputs.begin(), outputs.end());
+
+    switch (kind) {
+    case GL:
+    case NVG:
+    case CLGL:
+        s.inputs_.insert(FRAMEBUFFER);
+        s.outputs_.insert(FRAMEBUFFER);
+        break;
+    case CAPTURE:
+        s.outputs_.insert(FRAMEBUFFER);
+        break;
+    case WRITE:
+    case DISPLAY:
+        s.inputs_.insert(FRAMEBUFFER);
+        break;
+    default:
+        break;
+    }
+
+    dirty_ = true;
+    return s;
+}
+
+static bool intersects(const std::set<std::string>& a, const std::set<std::string>& b) {
+    for (const auto& r : a) {
+        if (b.find(r) != b.end())
+            return true;
+    }
+    return false;
+}
+
+//read-after-write, write-after-read and write-after-write. symmetric.
+bool FrameGraph::conflicts(const Stage& a, const Stage& b) {
+    return intersects(a.outputs_, b.inputs_) || intersects(a.outputs_, b.outputs_) || intersects(a.inputs_, b.outputs_);
+}
+
+//0 = doesn't touch the framebuffer, 1 = needs the texture, 2 = needs the UMat
+int FrameGraph::domain(const Stage& s) {
+    switch (s.kind_) {
+    case GL:
+    case NVG:
+    case DISPLAY:
+        return 1;
+    case CLGL:
+    case CAPTURE:
+    case WRITE:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+void FrameGraph::schedule() {
+    const size_t n = stages_.size();
+    std::vector<std::vector<size_t>> deps(n);
+    for (size_t j = 0; j < n; ++j) {
+        for (size_t i = 0; i < j; ++i) {
+            if (conflicts(stages_[i], stages_[j]))
+                deps[j].push_back(i);
+        }
+    }
+
+    //list scheduling in declaration order. CPU stages are started as early as possible and
+    //stages that stay in the current framebuffer domain are preferred to avoid GL/CL handoffs.
+    std::vector<bool> done(n, false);
+    int current = 0;
+    order_.clear();
+    while (order_.size() < n) {
+        size_t best = n;
+        int bestPrio = 3;
+        for (size_t i = 0; i < n; ++i) {
+            if (done[i])
+                continue;
+            if (!std::all_of(deps[i].begin(), deps[i].end(), [&](size_t d) { return done[d]; }))
+                continue;
+
+            int d = domain(stages_[i]);
+            int prio = stages_[i].kind_ == CPU ? 0 : (d == 0 || d == current) ? 1 : 2;
+            if (prio < bestPrio) {
+                best = i;
+                bestPrio = prio;
+            }
+        }
+        assert(best < n);
+        done[best] = true;
+        order_.push_back(best);
+        if (domain(stages_[best]) != 0)
+            current = domain(stages_[best]);
+    }
+
+    //acquired buffers are released after the last stage of the frame that declares them. CPU stages don't count.
+    std::map<std::string, size_t> last;
+    for (size_t i : order_) {
+        Stage& s = stages_[i];
+        s.lastUse_.clear();
+        if (s.kind_ == CPU)
+            continue;
+        for (const auto& r : s.inputs_)
+            last[r] = i;
+        for (const auto& r : s.outputs_)
+            last[r] = i;
+    }
+    for (const auto& [r, i] : last) {
+        if (r != FRAMEBUFFER)
+            stages_[i].lastUse_.push_back(r);
+    }
+    dirty_ = false;
+}
+
+void FrameGraph::join(Stage& s) {
+    if (s.pending_.valid())
+        s.pending_.get();
+}
+
+void FrameGraph::joinConflicting(const Stage& s) {
+    for (auto& p : stages_) {
+        if (p.pending_.valid() && (&p == &s || conflicts(p, s)))
+            join(p);
+    }
+}
+
+detail::BufferHandle FrameGraph::handle(const std::string& name) {
+    assert(name != FRAMEBUFFER);
+    auto it = handles_.find(name);
+    if (it != handles_.end())
+        return it->second;
+    return handles_[name] = detail::store().resolve(instance_, name);
+}
+
+void FrameGraph::release(const std::string& name) {
+    if (acquired_.erase(name))
+        detail::store().release(handle(name));
+}
+
+cv::UMat& FrameGraph::buf(const std::string& name) {
+    return detail::store().buf(handle(name));
+}
+
+cv::UMat& FrameGraph::buf(const std::string& name, const cv::Size& sz, int type, const cv::Scalar& defaultValue) {
+    release(name);
+    return detail::store().buf(detail::store().allocate(instance_, name, sz, type, defaultValue));
+}
+
+cv::UMat& FrameGraph::acquire(const std::string& name, const cv::Size& sz, int type) {
+    acquired_.insert(name);
+    return detail::store().acquire(handle(name), v2d_.arena(), sz, type);
+}
+
+FrameGraph& FrameGraph::capture() {
+    add("capture", CAPTURE, {}, {});
+    return *this;
+}
+
+FrameGraph& FrameGraph::capture(std::function<void(cv::UMat&)> fn) {
+    add("capture", CAPTURE, {}, {}).umatFn_ = fn;
+    return *this;
+}
+
+FrameGraph& FrameGraph::gl(const std::string& name, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs, std::function<void(const cv::Size&)> fn) {
+    add(name, GL, inputs, outputs).sizeFn_ = fn;
+    return *this;
+}
+
+FrameGraph& FrameGraph::cl(const std::string& name, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs, std::function<void()> fn) {
+    add(name, CL, inputs, outputs).fn_ = fn;
+    return *this;
+}
+
+FrameGraph& FrameGraph::clgl(const std::string& name, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs, std::function<void(cv::UMat&)> fn, cv::AccessFlag access) {
+    Stage& s = add(name, CLGL, inputs, outputs);
+    s.umatFn_ = fn;
+    s.access_ = access;
+    if (!(access & cv::ACCESS_WRITE) && std::find(outputs.begin(), outputs.end(), FRAMEBUFFER) == outputs.end())
+        s.outputs_.erase(FRAMEBUFFER);
+    if (!(access & cv::ACCESS_READ) && std::find(inputs.begin(), inputs.end(), FRAMEBUFFER) == inputs.end())
+        s.inputs_.erase(FRAMEBUFFER);
+    return *this;
+}
+
+FrameGraph& FrameGraph::nvg(const std::string& name, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs, std::function<void(const cv::Size&)> fn) {
+    add(name, NVG, inputs, outputs).sizeFn_ = fn;
+    return *this;
+}
+
+FrameGraph& FrameGraph::cpu(const std::string& name, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs, std::function<void()> fn) {
+    add(name, CPU, inputs, outputs).fn_ = fn;
+    return *this;
+}
+
+FrameGraph& FrameGraph::task(const std::string& name, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs, std::function<void()> fn) {
+    add(name, TASK, inputs, outputs).fn_ = fn;
+    return *this;
+}
+
+FrameGraph& FrameGraph::write() {
+    add("write", WRITE, {}, {});
+    return *this;
+}
+
+FrameGraph& FrameGraph::write(std::function<void(const cv::UMat&)> fn) {
+    add("write", WRITE, {}, {}).constUmatFn_ = fn;
+    return *this;
+}
+
+FrameGraph& FrameGraph::display() {
+    add("display", DISPLAY, {}, {});
+    return *this;
+}
+
+bool FrameGraph::run() {
+    if (dirty_)
+        schedule();
+
+    Tracer* tracer = v2d_.tracer_;
+    QualityController* quality = v2d_.quality_;
+    for (size_t i : order_) {
+        Stage& s = stages_[i];
+        joinConflicting(s);
+        Tracer::Scope trace(tracer, s.name_.c_str());
+        //cpu stages are measured on the worker
+        QualityController::Scope measure(s.kind_ == CPU ? nullptr : quality, s.name_);
+
+        switch (s.kind_) {
+        case CAPTURE:
+            if (!(s.umatFn_ ? v2d_.capture(s.umatFn_) : v2d_.capture())) {
+                releaseAll();
+                return false;
+            }
+            break;
+        case GL:
+            v2d_.gl(s.sizeFn_);
+            break;
+        case CL:
+            v2d_.cl(s.fn_);
+            break;
+        case CLGL:
+            v2d_.clgl(s.umatFn_, s.access_);
+            break;
+        case NVG:
+            v2d_.nvg(s.sizeFn_);
+            break;
+        case CPU: {
+            if (tracer || quality) {
+                //traced on the worker
+                s.pending_ = pool().push([tracer, quality, name = s.name_, fn = s.fn_]() {
+                    Tracer::Scope trace(tracer, name.c_str());
+                    QualityController::Scope measure(quality, name);
+                    fn();
+                });
+            } else {
+                s.pending_ = pool().push(s.fn_);
+            }
+            break;
+        }
+        case TASK:
+            s.fn_();
+            break;
+        case WRITE:
+            if (s.constUmatFn_)
+                v2d_.write(s.constUmatFn_);
+            else
+                v2d_.write();
+            break;
+        case DISPLAY:
+            if (!v2d_.display()) {
+                releaseAll();
+                return false;
+            }
+            break;
+        }
+        for (const auto& r : s.lastUse_)
+            release(r);
+    }
+    releaseAll();
+    return true;
+}
+
+void FrameGraph::releaseAll() {
+    while (!acquired_.empty())
+        release(*acquired_.begin());
+}
+
+void FrameGraph::finish() {
+    for (auto& s : stages_)
+        join(s);
+}
+
+void FrameGraph::clear() {
+    finish();
+    stages_.clear();
+    order_.clear();
+    dirty_ = false;
+}
+
+bool FrameGraph::empty() {
+    return stages_.empty();
+}
+
+std::vector<std::string> FrameGraph::getOrder() {
+    if (dirty_)
+        schedule();
+
+    std::vector<std::string> names;
+    for (size_t i : order_)
+        names.push_back(stages_[i].name_);
+    return names;
+}
+}
+}
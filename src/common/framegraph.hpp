@@ -0,0 +1,115 @@
+#ifndef SRC_COMMON_FRAMEGRAPH_HPP_
+#define SRC_COMMON_FRAMEGRAPH_HPP_
+
+#include "detail/bufferstore.hpp"
+
+#include <functional>
+#include <future>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+
+namespace kb {
+namespace viz2d {
+class Viz2D;
+
+/*!
+ * Declarative description of a frame. Stages declare which resources (the framebuffer or named buffers) they read and write.
+ * Named buffers are kept in the BufferStore. A buffer acquired for the frame goes back to the frame arena after the last
+ * stage that declares it, so the memory is reused by the stages after it.
+ * The graph derives the dependencies, orders the stages so that the framebuffer changes hands between GL and OpenCL as
+ * rarely as possible and runs CPU stages asynchronously on the shared pool. A CPU stage is only joined once a later stage (possibly of the
+ * next frame) touches one of its resources, so CPU work overlaps with GPU work of the current and the next frame.
+ */
+class FrameGraph {
+public:
+    enum StageKind {
+        CAPTURE,
+        GL,
+        CL,
+        CLGL,
+        NVG,
+        CPU,
+        TASK,
+        WRITE,
+        DISPLAY
+    };
+
+    //name of the framebuffer resource. gl, nvg and clgl stages implicitly read and write it.
+    static constexpr const char* FRAMEBUFFER = "framebuffer";
+private:
+    struct Stage {
+        std::string name_;
+        StageKind kind_;
+        std::set<std::string> inputs_;
+        std::set<std::string> outputs_;
+        std::function<void(const cv::Size&)> sizeFn_;
+        std::function<void()> fn_;
+        std::function<void(cv::UMat&)> umatFn_;
+        std::function<void(const cv::UMat&)> constUmatFn_;
+        cv::AccessFlag access_ = cv::ACCESS_RW;
+        //the buffers this stage is the last user of in the frame
+        std::vector<std::string> lastUse_;
+        std::future<void> pending_;
+    };
+
+    Viz2D& v2d_;
+    //the instance index of the buffers of this graph in the BufferStore
+    size_t instance_;
+    std::vector<Stage> stages_;
+    std::vector<size_t> order_;
+    std::map<std::string, detail::BufferHandle> handles_;
+    //buffers acquired in the current frame
+    std::set<std::string> acquired_;
+    bool dirty_ = false;
+
+    Stage& add(const std::string& name, StageKind kind, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs);
+    bool conflicts(const Stage& a, const Stage& b);
+    int domain(const Stage& s);
+    void schedule();
+    void join(Stage& s);
+    void joinConflicting(const Stage& s);
+    detail::BufferHandle handle(const std::string& name);
+    void release(const std::string& name);
+    void releaseAll();
+public:
+    FrameGraph(Viz2D& v2d);
+    virtual ~FrameGraph();
+
+    FrameGraph& capture();
+    FrameGraph& capture(std::function<void(cv::UMat&)> fn);
+    FrameGraph& gl(const std::string& name, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs, std::function<void(const cv::Size&)> fn);
+    FrameGraph& cl(const std::string& name, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs, std::function<void()> fn);
+    //a read-only stage doesn't write the framebuffer resource and a write-only stage doesn't read it
+    FrameGraph& clgl(const std::string& name, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs, std::function<void(cv::UMat&)> fn, cv::AccessFlag access = cv::ACCESS_RW);
+    FrameGraph& nvg(const std::string& name, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs, std::function<void(const cv::Size&)> fn);
+    FrameGraph& cpu(const std::string& name, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs, std::function<void()> fn);
+    //runs synchronously on the calling thread without any context setup
+    FrameGraph& task(const std::string& name, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs, std::function<void()> fn);
+    FrameGraph& write();
+    FrameGraph& write(std::function<void(const cv::UMat&)> fn);
+    FrameGraph& display();
+
+    //the buffer of a named resource. the reference stays valid for the lifetime of the graph, so stages can keep it.
+    cv::UMat& buf(const std::string& name);
+    //like buf() but (re)allocates a buffer that lives across frames and fills it with defaultValue
+    cv::UMat& buf(const std::string& name, const cv::Size& sz, int type, const cv::Scalar& defaultValue);
+    //takes the buffer of a named resource from the frame arena for the current frame and returns it. the content is
+    //undefined. it is released after the last stage that declares the resource. CPU stages mustn't touch graph buffers,
+    //they run on another thread and work on host copies.
+    cv::UMat& acquire(const std::string& name, const cv::Size& sz, int type);
+
+    //executes one frame. returns false if capturing failed or the window was closed.
+    bool run();
+    //waits for all CPU stages that are still running
+    void finish();
+    void clear();
+    bool empty();
+    std::vector<std::string> getOrder();
+};
+}
+}
+
+#endif /* SRC_COMMON_FRAMEGRAPH_HPP_ */
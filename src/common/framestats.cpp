@@ -0,0 +1,173 @@
+#include "framestats.hpp"
+#include "nvg.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+
+namespace kb {
+namespace viz2d {
+
+FrameStats::FrameStats(size_t window) : window_(std::max(window, size_t(1)), 0.0f) {
+}
+
+void FrameStats::tick() {
+    auto now = std::chrono::steady_clock::now();
+    if (started_)
+        record(std::chrono::duration<float, std::milli>(now - last_).count());
+    started_ = true;
+    last_ = now;
+}
+
+void FrameStats::record(float frameTimeMs) {
+    window_[next_] = frameTimeMs;
+    next_ = (next_ + 1) % window_.size();
+    ++count_;
+    dirty_ = true;
+
+    if (dump_.is_open()) {
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<double>(now - lastDump_).count() >= dumpInterval_) {
+            dump();
+            lastDump_ = now;
+        }
+    }
+}
+
+void FrameStats::reset() {
+    std::fill(window_.begin(), window_.end(), 0.0f);
+    next_ = 0;
+    count_ = 0;
+    started_ = false;
+    dirty_ = true;
+}
+
+size_t FrameStats::getCount() {
+    return count_;
+}
+
+std::vector<float> FrameStats::getFrameTimes() {
+    size_t n = std::min(count_, window_.size());
+    std::vector<float> times;
+    times.reserve(n);
+    //next_ is the oldest entry once the window is full
+    size_t first = count_ > window_.size() ? next_ : 0;
+    for (size_t i = 0; i < n; ++i)
+        times.push_back(window_[(first + i) % window_.size()]);
+    return times;
+}
+
+static float percentile_of_sorted(const std::vector<float>& sorted, float p) {
+    if (sorted.empty())
+        return 0;
+    size_t i = std::min(size_t(std::ceil(p / 100.0f * sorted.size())), sorted.size());
+    return sorted[i > 0 ? i - 1 : 0];
+}
+
+const FrameStats::Summary& FrameStats::getSummary() {
+    if (!dirty_)
+        return summary_;
+
+    std::vector<float> sorted = getFrameTimes();
+    std::sort(sorted.begin(), sorted.end());
+    summary_ = Summary();
+    summary_.frames_ = count_;
+    if (!sorted.empty()) {
+        summary_.min_ = sorted.front();
+        summary_.max_ = sorted.back();
+        summary_.mean_ = std::accumulate(sorted.begin(), sorted.end(), 0.0f) / sorted.size();
+        summary_.p50_ = percentile_of_sorted(sorted, 50);
+        summary_.p95_ = percentile_of_sorted(sorted, 95);
+        summary_.p99_ = percentile_of_sorted(sorted, 99);
+        summary_.fps_ = summary_.mean_ > 0 ? 1000.0f / summary_.mean_ : 0;
+    }
+    dirty_ = false;
+    return summary_;
+}
+
+float FrameStats::getPercentile(float p) {
+    std::vector<float> sorted = getFrameTimes();
+    std::sort(sorted.begin(), sorted.end());
+    return percentile_of_sorted(sorted, p);
+}
+
+std::vector<size_t> FrameStats::getHistogram(size_t buckets, float bucketMs) {
+    std::vector<size_t> histogram(buckets, 0);
+    if (buckets == 0 || bucketMs <= 0)
+        return histogram;
+
+    for (float t : getFrameTimes())
+        ++histogram[std::min(size_t(t / bucketMs), buckets - 1)];
+    return histogram;
+}
+
+bool FrameStats::setDumpFile(const std::string& filename, double intervalSeconds) {
+    if (dump_.is_open())
+        dump_.close();
+    if (filename.empty())
+        return true;
+
+    dump_.open(filename, std::ios::out | std::ios::app);
+    if (!dump_.is_open())
+        return false;
+    dumpInterval_ = intervalSeconds;
+    lastDump_ = std::chrono::steady_clock::now();
+    dump_ << "frames,min,mean,p50,p95,p99,max,fps" << std::endl;
+    return true;
+}
+
+void FrameStats::dump() {
+    const Summary& s = getSummary();
+    dump_ << s.frames_ << "," << s.min_ << "," << s.mean_ << "," << s.p50_ << "," << s.p95_ << "," << s.p99_ << "," << s.max_ << "," << s.fps_ << std::endl;
+}
+
+void FrameStats::draw(float x, float y, float w, float h) {
+    using namespace kb::viz2d::nvg;
+    const Summary& s = getSummary();
+    std::vector<float> times = getFrameTimes();
+    //at least two frames at 60 fps fit in
+    float scaleMs = std::max(33.3f, s.max_ * 1.1f);
+    float textHeight = 24;
+    float graphHeight = h - textHeight;
+
+    beginPath();
+    roundedRect(x, y, w, h, 5);
+    fillColor(cv::Scalar(255, 255, 255, 180));
+    fill();
+
+    //one bar per frame, newest right
+    if (!times.empty()) {
+        float barWidth = w / window_.size();
+        float bottom = y + h;
+        beginPath();
+        for (size_t i = 0; i < times.size(); ++i) {
+            float bx = x + w - (times.size() - i) * barWidth;
+            float bh = std::min(times[i] / scaleMs, 1.0f) * graphHeight;
+            rect(bx, bottom - bh, std::max(barWidth - 1, 1.0f), bh);
+        }
+        fillColor(cv::Scalar(90, 90, 90, 255));
+        fill();
+
+        //16.7ms and 33.3ms guides
+        for (float guide : { 1000.0f / 60.0f, 1000.0f / 30.0f }) {
+            float gy = bottom - (guide / scaleMs) * graphHeight;
+            beginPath();
+            moveTo(x, gy);
+            lineTo(x + w, gy);
+            strokeWidth(1);
+            strokeColor(cv::Scalar(0, 0, 255, 180));
+            stroke();
+        }
+    }
+
+    char label[128];
+    snprintf(label, sizeof(label), "%.1f fps  p50 %.1f  p99 %.1f ms", s.fps_, s.p50_, s.p99_);
+    fontSize(20.0f);
+    fontFace("mono");
+    fillColor(cv::Scalar(90, 90, 90, 255));
+    textAlign(NVG_ALIGN_LEFT | NVG_ALIGN_MIDDLE);
+    text(x + 5, y + textHeight / 2, label, nullptr);
+}
+} /* namespace viz2d */
+} /* namespace kb */
@@ -0,0 +1,65 @@
+#ifndef SRC_COMMON_FRAMESTATS_HPP_
+#define SRC_COMMON_FRAMESTATS_HPP_
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+
+namespace kb {
+namespace viz2d {
+
+/*!
+ * Frame time statistics of one Viz2D over a rolling window of frames. Viz2D::display() ticks it once per frame.
+ * Not thread safe.
+ */
+class FrameStats {
+public:
+    //all times in milliseconds
+    struct Summary {
+        size_t frames_ = 0;
+        float min_ = 0;
+        float mean_ = 0;
+        float p50_ = 0;
+        float p95_ = 0;
+        float p99_ = 0;
+        float max_ = 0;
+        float fps_ = 0;
+    };
+private:
+    std::vector<float> window_;
+    size_t next_ = 0;
+    size_t count_ = 0;
+    bool started_ = false;
+    std::chrono::steady_clock::time_point last_;
+    std::ofstream dump_;
+    double dumpInterval_ = 0;
+    std::chrono::steady_clock::time_point lastDump_;
+    Summary summary_;
+    bool dirty_ = true;
+
+    void dump();
+public:
+    FrameStats(size_t window = 240);
+    //measures the time since the last tick
+    void tick();
+    void record(float frameTimeMs);
+    void reset();
+    //frames recorded since the last reset
+    size_t getCount();
+    //the frame times of the window, oldest first
+    std::vector<float> getFrameTimes();
+    const Summary& getSummary();
+    float getPercentile(float p);
+    //number of frames of the window per bucket of bucketMs. the last bucket collects everything above.
+    std::vector<size_t> getHistogram(size_t buckets, float bucketMs);
+    //appends the summary to filename as csv every intervalSeconds. an empty filename stops dumping.
+    bool setDumpFile(const std::string& filename, double intervalSeconds = 1.0);
+    //draws a frame time graph at (x, y). has to be called inside Viz2D::nvg().
+    void draw(float x, float y, float w, float h);
+};
+} /* namespace viz2d */
+} /* namespace kb */
+
+#endif /* SRC_COMMON_FRAMESTATS_HPP_ */
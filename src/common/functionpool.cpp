@@ -1,61 +1,200 @@
 #include "functionpool.hpp"
 
 #include <iostream>
+#include <algorithm>
+#include <opencv2/core/ocl.hpp>
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 namespace kb {
 namespace viz2d {
 namespace detail {
 
-FunctionPool::FunctionPool() :
-        m_function_queue(), m_lock(), m_data_condition(), m_accept_functions(true) {
+//identifies the worker (if any) the current thread belongs to
+thread_local FunctionPool* current_pool = nullptr;
+thread_local size_t current_index = 0;
+
+FunctionPool::FunctionPool(size_t threads, bool pin) {
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (size_t i = 0; i < threads; ++i)
+        workers_.push_back(std::make_unique<Worker>());
+
+    for (size_t i = 0; i < threads; ++i) {
+        workers_[i]->thread_ = std::thread([this, i, pin]() {
+            run(i, pin);
+        });
+    }
 }
 
 FunctionPool::~FunctionPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMtx_);
+        running_ = false;
+    }
+    sleepCond_.notify_all();
+
+    for (auto& w : workers_) {
+        if (w->thread_.joinable())
+            w->thread_.join();
+    }
 }
 
-void FunctionPool::push(std::function<void()> func) {
-    std::unique_lock<std::mutex> lock(m_lock);
-    m_function_queue.push(func);
-    // when we send the notification immediately, the consumer will try to get the lock , so unlock asap
-    lock.unlock();
-    m_data_condition.notify_one();
+void FunctionPool::enqueue(Task&& task) {
+    Worker* target;
+    if (current_pool == this)
+        target = workers_[current_index].get();
+    else
+        target = workers_[next_++ % workers_.size()].get();
+
+    //count first, so pop() never decrements below zero
+    ++pending_;
+    {
+        std::lock_guard<std::mutex> lock(target->mtx_);
+        target->deque_.push_back(std::move(task));
+    }
+    //taking the lock makes sure a worker that is about to sleep sees pending_
+    {
+        std::lock_guard<std::mutex> lock(sleepMtx_);
+    }
+    sleepCond_.notify_one();
 }
 
-void FunctionPool::done() {
-    std::unique_lock<std::mutex> lock(m_lock);
-    m_accept_functions = false;
-    lock.unlock();
-    // when we send the notification immediately, the consumer will try to get the lock , so unlock asap
-    m_data_condition.notify_all();
-    //notify all waiting threads.
+bool FunctionPool::pop(size_t self, Task& task) {
+    const size_t n = workers_.size();
+    if (self < n) {
+        Worker& own = *workers_[self];
+        std::lock_guard<std::mutex> lock(own.mtx_);
+        if (!own.deque_.empty()) {
+            task = std::move(own.deque_.back());
+            own.deque_.pop_back();
+            --pending_;
+            return true;
+        }
+    }
+
+    //steal the oldest task of somebody else
+    for (size_t k = 1; k <= n; ++k) {
+        Worker& victim = *workers_[(self + k) % n];
+        std::lock_guard<std::mutex> lock(victim.mtx_);
+        if (!victim.deque_.empty()) {
+            task = std::move(victim.deque_.front());
+            victim.deque_.pop_front();
+            --pending_;
+            return true;
+        }
+    }
+    return false;
 }
 
-void FunctionPool::infinite_loop_func() {
-    std::function<void()> func;
+void FunctionPool::run(size_t index, bool pin) {
+    current_pool = this;
+    current_index = index;
+    //workers don't have a CL context bound and shouldn't create one
+    cv::ocl::setUseOpenCL(false);
+
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+    if (pin) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(index % std::max(std::thread::hardware_concurrency(), 1u), &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+            std::cerr << "Unable to pin worker " << index << std::endl;
+    }
+#endif
+
+    Task task;
     while (true) {
-        try {
-            {
-                std::unique_lock<std::mutex> lock(m_lock);
-                m_data_condition.wait(lock, [this]() {
-                    return !m_function_queue.empty() || !m_accept_functions;
-                });
-                if (!m_accept_functions && m_function_queue.empty()) {
-                    //lock will be release automatically.
-                    //finish the thread loop and let it join in the main thread.
-                    return;
-                }
-                func = m_function_queue.front();
-                m_function_queue.pop();
-                //release the lock
-            }
-            func();
-        } catch(std::exception& ex) {
-            std::cerr << ex.what() << std::endl;
+        if (pop(index, task)) {
+            task();
+            task = Task();
+            continue;
         }
+
+        std::unique_lock<std::mutex> lock(sleepMtx_);
+        sleepCond_.wait(lock, [this]() {
+            return pending_ > 0 || !running_;
+        });
+        if (!running_ && pending_ == 0)
+            return;
+    }
+}
+
+bool FunctionPool::runOne() {
+    Task task;
+    if (!pop(current_pool == this ? current_index : next_ % workers_.size(), task))
+        return false;
+    task();
+    return true;
+}
+
+void FunctionPool::parallelFor(size_t begin, size_t end, std::function<void(size_t, size_t)> fn, size_t grain) {
+    if (end <= begin)
+        return;
+
+    const size_t n = end - begin;
+    if (grain == 0)
+        grain = std::max(n / (workers_.size() * 4), size_t(1));
+    const size_t chunks = (n + grain - 1) / grain;
+
+    std::atomic<size_t> next = 0;
+    auto body = [&]() {
+        size_t c;
+        while ((c = next++) < chunks) {
+            size_t b = begin + c * grain;
+            fn(b, std::min(b + grain, end));
+        }
+    };
+
+    std::vector<std::future<void>> helpers;
+    for (size_t i = 0; i < std::min(chunks - 1, workers_.size()); ++i)
+        helpers.push_back(push(body));
+
+    try {
+        body();
+    } catch (...) {
+        //the helpers reference this stack frame
+        for (auto& h : helpers)
+            wait(h);
+        throw;
     }
 
+    for (auto& h : helpers) {
+        wait(h);
+        h.get();
+    }
 }
 
+size_t FunctionPool::size() {
+    return workers_.size();
+}
 } /* namespace detail */
+
+static std::mutex pool_mtx;
+static std::unique_ptr<detail::FunctionPool> default_pool;
+static size_t pool_threads = 0;
+static bool pool_pin = false;
+
+detail::FunctionPool& pool() {
+    std::lock_guard<std::mutex> lock(pool_mtx);
+    if (!default_pool)
+        default_pool.reset(new detail::FunctionPool(pool_threads, pool_pin));
+    return *default_pool;
+}
+
+bool configure_pool(size_t threads, bool pin) {
+    std::lock_guard<std::mutex> lock(pool_mtx);
+    //references returned by pool() may still be in use
+    if (default_pool) {
+        std::cerr << "The function pool is already in use and can't be configured anymore" << std::endl;
+        return false;
+    }
+    pool_threads = threads;
+    pool_pin = pin;
+    return true;
+}
 } /* namespace viz2d */
 } /* namespace kb */
@@ -1,36 +1,127 @@
-//started with https://stackoverflow.com/a/51400041/1884837
 #ifndef SRC_COMMON_FUNCTIONPOOL_HPP_
 #define SRC_COMMON_FUNCTIONPOOL_HPP_
 
-#include <queue>
+#include <deque>
+#include <vector>
+#include <memory>
 #include <functional>
+#include <future>
+#include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <chrono>
+#include <type_traits>
 #include <cassert>
 
 namespace kb {
 namespace viz2d {
 namespace detail {
 
+/*!
+ * Work-stealing thread pool. Every worker owns a deque. Workers pop their own tasks LIFO and steal from the front of the
+ * others' deques when they run dry. Tasks pushed from a worker go to its own deque, tasks from other threads are
+ * distributed round-robin. Workers never use OpenCL.
+ */
 class FunctionPool {
+public:
+    //move-only type erased task
+    class Task {
+        struct Concept {
+            virtual ~Concept() {
+            }
+            virtual void run() = 0;
+        };
+
+        template<typename F> struct Model : Concept {
+            F fn_;
+            Model(F&& fn) : fn_(std::move(fn)) {
+            }
+            void run() override {
+                fn_();
+            }
+        };
+
+        std::unique_ptr<Concept> impl_;
+    public:
+        Task() = default;
+        template<typename F> Task(F&& fn) : impl_(new Model<std::decay_t<F>>(std::forward<F>(fn))) {
+        }
+        Task(Task&&) = default;
+        Task& operator=(Task&&) = default;
 
+        void operator()() {
+            impl_->run();
+        }
+
+        explicit operator bool() const {
+            return impl_ != nullptr;
+        }
+    };
 private:
-    std::queue<std::function<void()>> m_function_queue;
-    std::mutex m_lock;
-    std::condition_variable m_data_condition;
-    std::atomic<bool> m_accept_functions;
+    struct Worker {
+        std::deque<Task> deque_;
+        std::mutex mtx_;
+        std::thread thread_;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::mutex sleepMtx_;
+    std::condition_variable sleepCond_;
+    std::atomic<size_t> pending_ = 0;
+    std::atomic<size_t> next_ = 0;
+    std::atomic<bool> running_ = true;
 
+    void enqueue(Task&& task);
+    bool pop(size_t self, Task& task);
+    void run(size_t index, bool pin);
 public:
+    //threads == 0 means one worker per hardware thread. pin binds worker i to cpu i.
+    FunctionPool(size_t threads = 0, bool pin = false);
+    virtual ~FunctionPool();
 
-    FunctionPool();
-    ~FunctionPool();
-    void push(std::function<void()> func);
-    void done();
-    void infinite_loop_func();
-};
+    template<typename F> auto push(F&& fn) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+        using R = std::invoke_result_t<std::decay_t<F>>;
+        std::packaged_task<R()> task(std::forward<F>(fn));
+        auto future = task.get_future();
+        enqueue(Task(std::move(task)));
+        return future;
+    }
+
+    //runs fn with the result of future once it is ready
+    template<typename T, typename F> auto then(std::future<T>&& future, F&& fn) {
+        return push([this, future = std::move(future), fn = std::forward<F>(fn)]() mutable {
+            wait(future);
+            if constexpr (std::is_void_v<T>) {
+                future.get();
+                return fn();
+            } else {
+                return fn(future.get());
+            }
+        });
+    }
+
+    //waits for future and helps executing tasks in the meantime, so it is safe to call from a worker
+    template<typename T> void wait(std::future<T>& future) {
+        while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (!runOne())
+                future.wait_for(std::chrono::microseconds(100));
+        }
+    }
 
+    //executes one pending task on the calling thread. returns false if there was none.
+    bool runOne();
+    //splits [begin, end) into chunks of grain size and calls fn(chunkBegin, chunkEnd) in parallel. the caller participates.
+    void parallelFor(size_t begin, size_t end, std::function<void(size_t, size_t)> fn, size_t grain = 0);
+    size_t size();
+};
 } /* namespace detail */
+
+//the pool shared by all Viz2D instances and the demos. it is created on first use.
+detail::FunctionPool& pool();
+//sets the number of threads (0 = hardware concurrency) and the cpu pinning of the shared pool. must be called before
+//the first use of pool(), returns false afterwards.
+bool configure_pool(size_t threads, bool pin);
 } /* namespace viz2d */
 } /* namespace kb */
 
@@ -6,7 +6,7 @@ namespace nvg {
 namespace detail {
 class NVG;
 
-NVG* NVG::nvg_instance_ = nullptr;
+thread_local NVG* NVG::nvg_instance_ = nullptr;
 
 void NVG::setCurrentContext(NVGcontext* ctx) {
     if(nvg_instance_ != nullptr)
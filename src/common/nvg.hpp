@@ -58,7 +58,8 @@ namespace detail {
 
 class NVG {
     friend class Viz2D;
-    static NVG* nvg_instance_;
+    //one per thread, so headless instances can render concurrently
+    static thread_local NVG* nvg_instance_;
     NVGcontext* ctx_ = nullptr;
 
 public:
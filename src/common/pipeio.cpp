@@ -0,0 +1,291 @@
+#include "pipeio.hpp"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/uio.h>
+#endif
+#include <opencv2/imgproc.hpp>
+
+namespace kb {
+namespace viz2d {
+
+//4:2:0 frames are 1.5 rows of luma per row
+static cv::Mat make_frame_buffer(const cv::Size& sz, PipeFormat format) {
+    if (format == PIPE_BGRA)
+        return cv::Mat(sz, CV_8UC4);
+    return cv::Mat(sz.height * 3 / 2, sz.width, CV_8UC1);
+}
+
+static bool read_fully(int fd, uchar* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::read(fd, data, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool read_line(int fd, std::string& line, size_t maxLength) {
+    line.clear();
+    char c;
+    while (line.size() < maxLength) {
+        if (!read_fully(fd, reinterpret_cast<uchar*>(&c), 1))
+            return false;
+        if (c == '\n')
+            return true;
+        line += c;
+    }
+    return false;
+}
+
+PipeSource::PipeSource(const std::string& path, PipeFormat format, const cv::Size& size, float fps) :
+        format_(format), size_(size), fps_(fps) {
+    if (path == "-") {
+        fd_ = STDIN_FILENO;
+    } else {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        owned_ = true;
+    }
+
+    if (fd_ < 0) {
+        std::cerr << "Unable to open: " << path << std::endl;
+        return;
+    }
+
+    if (format_ == PIPE_Y4M && !readHeader()) {
+        eof_ = true;
+        return;
+    }
+
+    if (size_.width <= 0 || size_.height <= 0 || (format_ != PIPE_BGRA && (size_.width % 2 || size_.height % 2))) {
+        std::cerr << "Invalid frame size for " << path << ": " << size_ << std::endl;
+        eof_ = true;
+        return;
+    }
+    raw_ = make_frame_buffer(size_, format_);
+}
+
+PipeSource::~PipeSource() {
+    if (owned_ && fd_ >= 0)
+        ::close(fd_);
+}
+
+bool PipeSource::readHeader() {
+    std::string header;
+    if (!read_line(fd_, header, 1024) || header.rfind("YUV4MPEG2", 0) != 0) {
+        std::cerr << "Not a YUV4MPEG2 stream" << std::endl;
+        return false;
+    }
+
+    std::istringstream iss(header.substr(9));
+    std::string token;
+    while (iss >> token) {
+        switch (token[0]) {
+        case 'W':
+        case 'H': {
+            int value = 0;
+            char rest;
+            if (sscanf(token.c_str() + 1, "%d%c", &value, &rest) != 1) {
+                std::cerr << "Malformed YUV4MPEG2 header: " << token << std::endl;
+                return false;
+            }
+            (token[0] == 'W' ? size_.width : size_.height) = value;
+            break;
+        }
+        case 'F': {
+            int num = 0, den = 1;
+            if (sscanf(token.c_str() + 1, "%d:%d", &num, &den) == 2 && den > 0)
+                fps_ = float(num) / den;
+            break;
+        }
+        case 'C':
+            //420jpeg, 420mpeg2 and 420paldv only differ in chroma siting. anything else, like 420p10, isn't 8 bit 4:2:0.
+            if (token != "C420" && token != "C420jpeg" && token != "C420mpeg2" && token != "C420paldv") {
+                std::cerr << "Unsupported YUV4MPEG2 colorspace: " << token << std::endl;
+                return false;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+bool PipeSource::skipFrameHeader() {
+    //usually just "FRAME\n"
+    char buf[6];
+    if (!read_fully(fd_, reinterpret_cast<uchar*>(buf), sizeof(buf)) || memcmp(buf, "FRAME", 5) != 0)
+        return false;
+    std::string params;
+    return buf[5] == '\n' || read_line(fd_, params, 1024);
+}
+
+bool PipeSource::read(cv::UMat& frame) {
+    if (eof_ || !isOpened() || (format_ == PIPE_Y4M && !skipFrameHeader()) || !read_fully(fd_, raw_.data, raw_.total() * raw_.elemSize())) {
+        eof_ = true;
+        frame.release();
+        return false;
+    }
+
+    switch (format_) {
+    case PIPE_BGRA:
+        cv::cvtColor(raw_, frame, cv::COLOR_BGRA2BGR);
+        break;
+    case PIPE_NV12:
+        cv::cvtColor(raw_, frame, cv::COLOR_YUV2BGR_NV12);
+        break;
+    case PIPE_Y4M:
+        cv::cvtColor(raw_, frame, cv::COLOR_YUV2BGR_I420);
+        break;
+    }
+    return true;
+}
+
+cv::Size PipeSource::getSize() {
+    return size_;
+}
+
+float PipeSource::getFPS() {
+    return fps_;
+}
+
+bool PipeSource::isOpened() {
+    return fd_ >= 0 && !raw_.empty();
+}
+
+PipeSink::PipeSink(const std::string& path, PipeFormat format, const cv::Size& size, float fps) :
+        format_(format), size_(size), fps_(fps) {
+    if (path == "-") {
+        fd_ = STDOUT_FILENO;
+    } else {
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        owned_ = true;
+    }
+
+    if (fd_ < 0) {
+        std::cerr << "Unable to open: " << path << std::endl;
+        return;
+    }
+
+    if (format_ != PIPE_BGRA && (size_.width % 2 || size_.height % 2)) {
+        std::cerr << "4:2:0 output needs an even frame size: " << size_ << std::endl;
+        if (owned_)
+            ::close(fd_);
+        fd_ = -1;
+        return;
+    }
+
+    if (fps_ <= 0)
+        fps_ = 30;
+    size_t frameBytes = format_ == PIPE_BGRA ? size_t(size_.width) * size_.height * 4 : size_t(size_.width) * size_.height * 3 / 2;
+    size_t poolSize = 1;
+#ifdef __linux__
+    struct stat st;
+    if (fstat(fd_, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        int pipeSize = fcntl(fd_, F_GETPIPE_SZ);
+        if (pipeSize > 0) {
+            splice_ = true;
+            //once a pipe worth of data has been spliced behind a buffer, the reader has consumed all of its pages
+            poolSize = 1 + (pipeSize + frameBytes - 1) / frameBytes + 1;
+        }
+    }
+#endif
+    for (size_t i = 0; i < poolSize; ++i)
+        pool_.push_back(make_frame_buffer(size_, format_));
+}
+
+PipeSink::~PipeSink() {
+    if (owned_ && fd_ >= 0)
+        ::close(fd_);
+}
+
+bool PipeSink::writeAll(const uchar* data, size_t len, bool spliceable) {
+    while (len > 0) {
+        ssize_t n;
+#ifdef __linux__
+        if (splice_ && spliceable) {
+            struct iovec iov = { const_cast<uchar*>(data), len };
+            n = vmsplice(fd_, &iov, 1, 0);
+            if (n < 0 && errno != EINTR && errno != EAGAIN) {
+                //not supported for this pipe. write() copies, so the pool isn't needed anymore.
+                splice_ = false;
+                continue;
+            }
+        } else
+#endif
+        n = ::write(fd_, data, len);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool PipeSink::write(const cv::UMat& frame) {
+    if (!isOpened())
+        return false;
+
+    if (format_ == PIPE_Y4M && !headerWritten_) {
+        std::ostringstream header;
+        header << "YUV4MPEG2 W" << size_.width << " H" << size_.height << " F" << std::lround(fps_ * 1000) << ":1000 Ip A1:1 C420jpeg\n";
+        std::string s = header.str();
+        //s is gone before the reader gets to it, so it must be copied
+        if (!writeAll(reinterpret_cast<const uchar*>(s.data()), s.size(), false))
+            return false;
+        headerWritten_ = true;
+    }
+
+    cv::Mat& buf = pool_[next_];
+    next_ = (next_ + 1) % pool_.size();
+    switch (format_) {
+    case PIPE_BGRA:
+        cv::cvtColor(frame, buf, cv::COLOR_BGR2BGRA);
+        break;
+    case PIPE_NV12: {
+        //opencv has no direct conversion to NV12, so interleave the chroma planes of I420
+        cv::cvtColor(frame, i420_, cv::COLOR_BGR2YUV_I420);
+        int w = size_.width;
+        int h = size_.height;
+        i420_.rowRange(0, h).copyTo(buf.rowRange(0, h));
+        std::vector<cv::Mat> planes = { cv::Mat(h / 2, w / 2, CV_8UC1, i420_.ptr(h)), cv::Mat(h / 2, w / 2, CV_8UC1, i420_.ptr(h) + (w / 2) * (h / 2)) };
+        cv::Mat uv(h / 2, w / 2, CV_8UC2, buf.ptr(h));
+        cv::merge(planes, uv);
+        break;
+    }
+    case PIPE_Y4M: {
+        static const char frameHeader[] = "FRAME\n";
+        if (!writeAll(reinterpret_cast<const uchar*>(frameHeader), sizeof(frameHeader) - 1, true))
+            return false;
+        cv::cvtColor(frame, buf, cv::COLOR_BGR2YUV_I420);
+        break;
+    }
+    }
+    assert(buf.isContinuous());
+    return writeAll(buf.data, buf.total() * buf.elemSize(), true);
+}
+
+bool PipeSink::isOpened() {
+    return fd_ >= 0;
+}
+
+cv::Size PipeSink::getSize() {
+    return size_;
+}
+} /* namespace viz2d */
+} /* namespace kb */
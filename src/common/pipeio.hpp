@@ -0,0 +1,77 @@
+#ifndef SRC_COMMON_PIPEIO_HPP_
+#define SRC_COMMON_PIPEIO_HPP_
+
+#include "source.hpp"
+#include "sink.hpp"
+
+#include <string>
+#include <vector>
+
+namespace kb {
+namespace viz2d {
+
+//the frame formats on a pipe
+enum PipeFormat {
+    //raw BGRA frames without any header
+    PIPE_BGRA,
+    //raw NV12 frames without any header
+    PIPE_NV12,
+    //YUV4MPEG2 with 4:2:0 chroma, as written by "ffmpeg -f yuv4mpegpipe"
+    PIPE_Y4M
+};
+
+/*!
+ * Reads frames from stdin ("-"), a named pipe or a file without decoding. The raw formats need the frame size, Y4M
+ * takes it from the stream header. Every frame is read in one go into a reused host buffer.
+ */
+class PipeSource : public Source {
+    int fd_ = -1;
+    bool owned_ = false;
+    PipeFormat format_;
+    cv::Size size_;
+    float fps_;
+    bool eof_ = false;
+    cv::Mat raw_;
+
+    bool readHeader();
+    bool skipFrameHeader();
+public:
+    PipeSource(const std::string& path, PipeFormat format, const cv::Size& size = cv::Size(), float fps = 0);
+    virtual ~PipeSource();
+    bool read(cv::UMat& frame) override;
+    cv::Size getSize() override;
+    float getFPS() override;
+    bool isOpened() override;
+};
+
+/*!
+ * Writes frames to stdout ("-"), a named pipe or a file without encoding. If the output is a pipe the frames are
+ * handed over with vmsplice(), so the consumer reads the pages of the frame buffers without a copy into the kernel.
+ * That's why the buffers are pooled: a buffer is only reused after more than a pipe worth of data has been written
+ * behind it.
+ */
+class PipeSink : public Sink {
+    int fd_ = -1;
+    bool owned_ = false;
+    bool splice_ = false;
+    PipeFormat format_;
+    cv::Size size_;
+    float fps_;
+    bool headerWritten_ = false;
+    std::vector<cv::Mat> pool_;
+    size_t next_ = 0;
+    cv::Mat i420_;
+
+    //only memory that outlives the read of the consumer, the pool and static data, may be spliced
+    bool writeAll(const uchar* data, size_t len, bool spliceable);
+public:
+    PipeSink(const std::string& path, PipeFormat format, const cv::Size& size, float fps);
+    virtual ~PipeSink();
+    bool write(const cv::UMat& frame) override;
+    bool isOpened() override;
+    cv::Size getSize() override;
+};
+} /* namespace viz2d */
+} /* namespace kb */
+
+#endif /* SRC_COMMON_PIPEIO_HPP_ */
@@ -0,0 +1,158 @@
+#include "qualitycontroller.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace kb {
+namespace viz2d {
+
+//weight of the newest measurement in the moving averages
+constexpr float SMOOTHING = 0.1f;
+
+QualityController::QualityController(float budgetMs) : budgetMs_(budgetMs), log_(&std::cerr) {
+}
+
+void QualityController::setBudget(float ms) {
+    budgetMs_ = ms;
+}
+
+float QualityController::getBudget() {
+    return budgetMs_;
+}
+
+void QualityController::setEnabled(bool e) {
+    enabled_ = e;
+}
+
+bool QualityController::isEnabled() {
+    return enabled_;
+}
+
+void QualityController::setHysteresis(size_t patience, size_t cooldown) {
+    patience_ = std::max(patience, size_t(1));
+    cooldown_ = cooldown;
+}
+
+void QualityController::setLog(std::ostream* os) {
+    log_ = os;
+}
+
+void QualityController::addKnob(const std::string& name, const std::string& stage, std::function<double()> get, std::function<void(double)> set, double cheapest, double step) {
+    knobs_.push_back({ name, stage, get, set, cheapest, std::fabs(step) });
+}
+
+void QualityController::record(const std::string& stage, float ms) {
+    std::lock_guard<std::mutex> guard(mtx_);
+    //a stage may run more than once per frame
+    frameCost_[stage] += ms;
+}
+
+void QualityController::update() {
+    auto now = std::chrono::steady_clock::now();
+    if (started_)
+        update(std::chrono::duration<float, std::milli>(now - last_).count());
+    started_ = true;
+    last_ = now;
+}
+
+void QualityController::change(size_t knob, double to) {
+    Knob& k = knobs_[knob];
+    double from = k.get_();
+    k.set_(to);
+    decisions_.push_back({ frames_, k.name_, from, to, frameTimeMs_ });
+    if (log_) {
+        *log_ << "quality: frame " << frames_ << " at " << frameTimeMs_ << "ms (budget " << budgetMs_ << "ms): " << k.name_ << " " << from << " -> " << to;
+        if (!k.stage_.empty())
+            *log_ << " (" << k.stage_ << " " << getStageCost(k.stage_) << "ms)";
+        *log_ << std::endl;
+    }
+    over_ = 0;
+    under_ = 0;
+    wait_ = cooldown_;
+}
+
+void QualityController::update(float frameTimeMs) {
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        for (auto& [stage, ms] : frameCost_) {
+            auto it = stageCost_.find(stage);
+            if (it == stageCost_.end())
+                stageCost_[stage] = ms;
+            else
+                it->second += SMOOTHING * (ms - it->second);
+            ms = 0;
+        }
+    }
+    frameTimeMs_ = frames_ == 0 ? frameTimeMs : frameTimeMs_ + SMOOTHING * (frameTimeMs - frameTimeMs_);
+    ++frames_;
+
+    if (!enabled_ || knobs_.empty())
+        return;
+
+    //don't raise a knob above a value somebody else has set since
+    while (!lowered_.empty() && std::fabs(knobs_[lowered_.back().knob_].get_() - lowered_.back().to_) > 1e-9)
+        lowered_.pop_back();
+
+    if (wait_ > 0) {
+        --wait_;
+        return;
+    }
+
+    if (frameTimeMs_ > budgetMs_) {
+        under_ = 0;
+        if (++over_ < patience_)
+            return;
+
+        //lower the knob of the most expensive stage that can still go down
+        size_t best = knobs_.size();
+        float bestCost = -1;
+        for (size_t i = 0; i < knobs_.size(); ++i) {
+            Knob& k = knobs_[i];
+            if (std::fabs(k.get_() - k.cheapest_) < 1e-9)
+                continue;
+            float cost = k.stage_.empty() ? 0 : getStageCost(k.stage_);
+            if (cost > bestCost) {
+                best = i;
+                bestCost = cost;
+            }
+        }
+        if (best == knobs_.size())
+            return;
+
+        Knob& k = knobs_[best];
+        double v = k.get_();
+        double to = v > k.cheapest_ ? std::max(v - k.step_, k.cheapest_) : std::min(v + k.step_, k.cheapest_);
+        change(best, to);
+        //read back, the knob might not be able to hold to exactly
+        lowered_.push_back({ best, v, k.get_() });
+    } else if (frameTimeMs_ < budgetMs_ * headroom_ && !lowered_.empty()) {
+        over_ = 0;
+        //raising takes longer than lowering, so quality doesn't flicker around the budget
+        if (++under_ < patience_ * 3)
+            return;
+
+        Lowered l = lowered_.back();
+        lowered_.pop_back();
+        change(l.knob_, l.from_);
+    } else {
+        over_ = 0;
+        under_ = 0;
+    }
+}
+
+float QualityController::getFrameTime() {
+    return frameTimeMs_;
+}
+
+float QualityController::getStageCost(const std::string& stage) {
+    std::lock_guard<std::mutex> guard(mtx_);
+    auto it = stageCost_.find(stage);
+    return it == stageCost_.end() ? 0 : it->second;
+}
+
+const std::vector<QualityController::Decision>& QualityController::getDecisions() {
+    return decisions_;
+}
+} /* namespace viz2d */
+} /* namespace kb */
@@ -0,0 +1,127 @@
+#ifndef SRC_COMMON_QUALITYCONTROLLER_HPP_
+#define SRC_COMMON_QUALITYCONTROLLER_HPP_
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace kb {
+namespace viz2d {
+
+/*!
+ * Keeps the frame time within a budget by turning registered quality knobs down when frames are too slow and back up
+ * when there is headroom. The knob of the most expensive stage is lowered first and knobs are raised in the reverse
+ * order, never above the value they had when they were registered. A knob that is changed from the outside, e.g. in
+ * the GUI, keeps that value: the controller forgets that it lowered it. Changes only happen after the frame time stayed
+ * out of bounds for a number of frames and are followed by a cool down, so the controller doesn't oscillate.
+ *
+ * Stage costs are wall times of the stages of the FrameGraph (asynchronous GPU work is attributed to the stage that
+ * waits for it). Viz2D::display() calls update() once per frame, which is also when knobs change.
+ */
+class QualityController {
+public:
+    struct Decision {
+        size_t frame_;
+        std::string knob_;
+        double from_;
+        double to_;
+        float frameTimeMs_;
+    };
+
+    //measures the time until it goes out of scope and records it for stage
+    class Scope {
+        QualityController* controller_;
+        //a copy, the name passed in may not outlive the scope
+        std::string stage_;
+        std::chrono::steady_clock::time_point begin_;
+    public:
+        //controller may be null
+        Scope(QualityController* controller, const std::string& stage) : controller_(controller), stage_(controller ? stage : std::string()) {
+            if (controller_)
+                begin_ = std::chrono::steady_clock::now();
+        }
+
+        ~Scope() {
+            if (controller_)
+                controller_->record(stage_, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin_).count());
+        }
+    };
+private:
+    struct Knob {
+        std::string name_;
+        std::string stage_;
+        std::function<double()> get_;
+        std::function<void(double)> set_;
+        double cheapest_;
+        double step_;
+    };
+
+    struct Lowered {
+        size_t knob_;
+        double from_;
+        //the value the controller left the knob at
+        double to_;
+    };
+
+    float budgetMs_;
+    bool enabled_ = true;
+    //how far below the budget the frame time has to be before quality is raised again
+    float headroom_ = 0.8f;
+    size_t patience_ = 10;
+    size_t cooldown_ = 30;
+    std::vector<Knob> knobs_;
+    //the knobs in the order they were lowered
+    std::vector<Lowered> lowered_;
+    std::map<std::string, float> stageCost_;
+    std::map<std::string, float> frameCost_;
+    std::mutex mtx_;
+    float frameTimeMs_ = 0;
+    size_t frames_ = 0;
+    size_t over_ = 0;
+    size_t under_ = 0;
+    size_t wait_ = 0;
+    bool started_ = false;
+    std::chrono::steady_clock::time_point last_;
+    std::vector<Decision> decisions_;
+    std::ostream* log_;
+
+    void addKnob(const std::string& name, const std::string& stage, std::function<double()> get, std::function<void(double)> set, double cheapest, double step);
+    void change(size_t knob, double to);
+public:
+    QualityController(float budgetMs = 1000.0f / 30.0f);
+    void setBudget(float ms);
+    float getBudget();
+    void setEnabled(bool e);
+    bool isEnabled();
+    //out of bounds frames before a knob is changed and frames after a change during which nothing changes
+    void setHysteresis(size_t patience, size_t cooldown);
+    //decisions are logged to os. null disables logging.
+    void setLog(std::ostream* os);
+
+    //value is lowered in steps down to cheapest. stage is the FrameGraph stage whose cost the knob affects.
+    template<typename T> void addKnob(const std::string& name, T& value, T cheapest, T step, const std::string& stage = "") {
+        addKnob(name, stage, [&value]() {
+            return double(value);
+        }, [&value](double v) {
+            value = T(v);
+        }, cheapest, step);
+    }
+
+    //thread safe
+    void record(const std::string& stage, float ms);
+    //measures the frame time since the last call and adjusts the knobs
+    void update();
+    void update(float frameTimeMs);
+    //smoothed over the last frames
+    float getFrameTime();
+    float getStageCost(const std::string& stage);
+    const std::vector<Decision>& getDecisions();
+};
+} /* namespace viz2d */
+} /* namespace kb */
+
+#endif /* SRC_COMMON_QUALITYCONTROLLER_HPP_ */
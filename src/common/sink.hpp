@@ -0,0 +1,24 @@
+#ifndef SRC_COMMON_SINK_HPP_
+#define SRC_COMMON_SINK_HPP_
+
+#include <opencv2/core.hpp>
+
+namespace kb {
+namespace viz2d {
+
+/*!
+ * A writer that can be plugged into Viz2D::setSink() instead of a cv::VideoWriter. Frames are BGR (CV_8UC3) of the
+ * video frame size, like the ones passed to cv::VideoWriter. write() may be called from the encoder thread.
+ */
+class Sink {
+public:
+    virtual ~Sink() {
+    }
+    virtual bool write(const cv::UMat& frame) = 0;
+    virtual bool isOpened() = 0;
+    virtual cv::Size getSize() = 0;
+};
+} /* namespace viz2d */
+} /* namespace kb */
+
+#endif /* SRC_COMMON_SINK_HPP_ */
@@ -0,0 +1,27 @@
+#ifndef SRC_COMMON_SOURCE_HPP_
+#define SRC_COMMON_SOURCE_HPP_
+
+#include <opencv2/core.hpp>
+
+namespace kb {
+namespace viz2d {
+
+/*!
+ * A capture source that can be plugged into Viz2D::setSource() instead of a cv::VideoCapture. Frames are BGR (CV_8UC3)
+ * like the ones of cv::VideoCapture. read() may be called from the prefetcher thread.
+ */
+class Source {
+public:
+    virtual ~Source() {
+    }
+    //returns false (or an empty frame) at the end of the stream
+    virtual bool read(cv::UMat& frame) = 0;
+    virtual cv::Size getSize() = 0;
+    //0 if unknown
+    virtual float getFPS() = 0;
+    virtual bool isOpened() = 0;
+};
+} /* namespace viz2d */
+} /* namespace kb */
+
+#endif /* SRC_COMMON_SOURCE_HPP_ */
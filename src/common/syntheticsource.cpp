@@ -0,0 +1,105 @@
+#include "syntheticsource.hpp"
+
+#include <algorithm>
+#include <opencv2/imgproc.hpp>
+
+namespace kb {
+namespace viz2d {
+
+SyntheticSource::SyntheticSource(const cv::Size& size, float fps, uint64_t seed, size_t sceneCutInterval, size_t numShapes, int noise, size_t length) :
+        size_(size), fps_(fps), sceneCutInterval_(sceneCutInterval), numShapes_(numShapes), noise_(noise), length_(length), rng_(seed), frame_(size, CV_8UC3), noiseFrame_(size, CV_8UC3) {
+    cut();
+}
+
+SyntheticSource::~SyntheticSource() {
+}
+
+void SyntheticSource::cut() {
+    backgroundColor_ = cv::Scalar(rng_.uniform(0, 128), rng_.uniform(0, 128), rng_.uniform(0, 128));
+    float maxRadius = std::max(std::min(size_.width, size_.height) / 10.0f, 2.0f);
+    float maxSpeed = std::max(size_.width, size_.height) / 100.0f;
+    shapes_.clear();
+    for (size_t i = 0; i < numShapes_; ++i) {
+        Shape s;
+        s.pos_ = cv::Point2f(rng_.uniform(0.0f, float(size_.width)), rng_.uniform(0.0f, float(size_.height)));
+        s.velocity_ = cv::Point2f(rng_.uniform(-maxSpeed, maxSpeed), rng_.uniform(-maxSpeed, maxSpeed));
+        s.radius_ = rng_.uniform(2.0f, maxRadius);
+        s.color_ = cv::Scalar(rng_.uniform(128, 256), rng_.uniform(128, 256), rng_.uniform(128, 256));
+        s.rect_ = rng_.uniform(0, 2) == 1;
+        shapes_.push_back(s);
+    }
+}
+
+void SyntheticSource::render(cv::Mat& frame) {
+    if (sceneCutInterval_ > 0 && index_ > 0 && index_ % sceneCutInterval_ == 0)
+        cut();
+
+    frame.setTo(backgroundColor_);
+    for (auto& s : shapes_) {
+        cv::Point center(s.pos_);
+        int r = s.radius_;
+        if (s.rect_)
+            cv::rectangle(frame, cv::Rect(center.x - r, center.y - r, 2 * r, 2 * r), s.color_, cv::FILLED);
+        else
+            cv::circle(frame, center, r, s.color_, cv::FILLED, cv::LINE_AA);
+
+        //bounce off the borders
+        s.pos_ += s.velocity_;
+        if (s.pos_.x < 0 || s.pos_.x >= size_.width)
+            s.velocity_.x = -s.velocity_.x;
+        if (s.pos_.y < 0 || s.pos_.y >= size_.height)
+            s.velocity_.y = -s.velocity_.y;
+    }
+
+    if (noise_ > 0) {
+        rng_.fill(noiseFrame_, cv::RNG::UNIFORM, 0, noise_);
+        cv::add(frame, noiseFrame_, frame);
+    }
+    ++index_;
+}
+
+void SyntheticSource::setLoopLength(size_t frames) {
+    loop_.clear();
+    for (size_t i = 0; i < frames; ++i) {
+        render(frame_);
+        loop_.push_back(frame_.getUMat(cv::ACCESS_READ).clone());
+    }
+    //reading continues with the first frame of the loop
+    index_ -= frames;
+    loopStart_ = index_;
+}
+
+bool SyntheticSource::read(cv::UMat& frame) {
+    if (length_ > 0 && index_ >= length_) {
+        frame.release();
+        return false;
+    }
+
+    if (!loop_.empty()) {
+        //the frames of the loop are shared and must not be modified
+        frame = loop_[(index_ - loopStart_) % loop_.size()];
+        ++index_;
+    } else {
+        render(frame_);
+        frame_.copyTo(frame);
+    }
+    return true;
+}
+
+cv::Size SyntheticSource::getSize() {
+    return size_;
+}
+
+float SyntheticSource::getFPS() {
+    return fps_;
+}
+
+bool SyntheticSource::isOpened() {
+    return true;
+}
+
+size_t SyntheticSource::getIndex() {
+    return index_;
+}
+} /* namespace viz2d */
+} /* namespace kb */
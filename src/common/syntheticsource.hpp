@@ -0,0 +1,61 @@
+#ifndef SRC_COMMON_SYNTHETICSOURCE_HPP_
+#define SRC_COMMON_SYNTHETICSOURCE_HPP_
+
+#include "source.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace kb {
+namespace viz2d {
+
+/*!
+ * Generates frames of moving shapes on a noisy background in memory, so pipelines can be measured without decoding and
+ * disk I/O. The output only depends on the parameters, so two runs with the same seed see the same frames. Every
+ * sceneCutInterval frames the background and the shapes change abruptly.
+ */
+class SyntheticSource : public Source {
+    struct Shape {
+        cv::Point2f pos_;
+        cv::Point2f velocity_;
+        float radius_;
+        cv::Scalar color_;
+        bool rect_;
+    };
+
+    cv::Size size_;
+    float fps_;
+    size_t sceneCutInterval_;
+    size_t numShapes_;
+    int noise_;
+    size_t length_;
+    cv::RNG rng_;
+    cv::Scalar backgroundColor_;
+    std::vector<Shape> shapes_;
+    cv::Mat frame_;
+    cv::Mat noiseFrame_;
+    //pregenerated frames that are replayed in a loop
+    std::vector<cv::UMat> loop_;
+    //the index of the first frame of the loop
+    size_t loopStart_ = 0;
+    size_t index_ = 0;
+
+    void cut();
+    void render(cv::Mat& frame);
+public:
+    //sceneCutInterval 0 means no scene cuts, length 0 an endless stream. noise is the maximum amplitude of the noise.
+    SyntheticSource(const cv::Size& size, float fps = 30, uint64_t seed = 0, size_t sceneCutInterval = 0, size_t numShapes = 32, int noise = 16, size_t length = 0);
+    virtual ~SyntheticSource();
+    //pregenerates the next frames and replays them in a loop, so reading a frame costs nothing. 0 generates every frame.
+    void setLoopLength(size_t frames);
+    bool read(cv::UMat& frame) override;
+    cv::Size getSize() override;
+    float getFPS() override;
+    bool isOpened() override;
+    //number of frames read since creation
+    size_t getIndex();
+};
+} /* namespace viz2d */
+} /* namespace kb */
+
+#endif /* SRC_COMMON_SYNTHETICSOURCE_HPP_ */
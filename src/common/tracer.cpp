@@ -0,0 +1,124 @@
+#include "tracer.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+
+namespace kb {
+namespace viz2d {
+
+//small and stable thread ids make the trace readable
+static std::atomic<uint32_t> next_thread_id = 0;
+static thread_local uint32_t thread_id = next_thread_id++;
+
+Tracer::Tracer(size_t capacity) : epoch_(std::chrono::steady_clock::now()) {
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    ring_.reset(new Event[size]);
+    mask_ = size - 1;
+}
+
+void Tracer::setEnabled(bool e) {
+    enabled_ = e;
+}
+
+uint64_t Tracer::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch_).count();
+}
+
+void Tracer::record(const char* name, uint64_t begin, uint64_t end) {
+    uint64_t index = head_.fetch_add(1, std::memory_order_relaxed);
+    Event& e = ring_[index & mask_];
+    e.seq_.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    strncpy(e.name_, name, sizeof(e.name_) - 1);
+    e.name_[sizeof(e.name_) - 1] = '\0';
+    e.begin_ = begin;
+    e.end_ = end;
+    e.frame_ = frame_.load(std::memory_order_relaxed);
+    e.thread_ = thread_id;
+    e.seq_.store(index + 1, std::memory_order_release);
+}
+
+void Tracer::nextFrame() {
+    if (isEnabled()) {
+        uint64_t t = now();
+        record("frame", t, t);
+    }
+    ++frame_;
+}
+
+uint64_t Tracer::getFrame() {
+    return frame_;
+}
+
+void Tracer::clear() {
+    for (size_t i = 0; i <= mask_; ++i)
+        ring_[i].seq_ = 0;
+}
+
+static void write_escaped(std::ostream& os, const char* s) {
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\')
+            os << '\\' << *s;
+        else if (static_cast<unsigned char>(*s) >= 0x20)
+            os << *s;
+    }
+}
+
+void Tracer::writeChromeTrace(std::ostream& os) {
+    struct Copy {
+        char name_[32];
+        uint64_t begin_, end_, frame_;
+        uint32_t thread_;
+    };
+    std::vector<Copy> events;
+    events.reserve(mask_ + 1);
+
+    //take a consistent copy of every slot. slots that are being written are skipped.
+    for (size_t i = 0; i <= mask_; ++i) {
+        Event& e = ring_[i];
+        uint64_t seq = e.seq_.load(std::memory_order_acquire);
+        if (seq == 0)
+            continue;
+        Copy c;
+        memcpy(c.name_, e.name_, sizeof(c.name_));
+        c.begin_ = e.begin_;
+        c.end_ = e.end_;
+        c.frame_ = e.frame_;
+        c.thread_ = e.thread_;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (e.seq_.load(std::memory_order_relaxed) == seq)
+            events.push_back(c);
+    }
+
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    os << std::fixed << std::setprecision(3);
+    bool first = true;
+    for (const auto& c : events) {
+        if (!first)
+            os << ",";
+        first = false;
+        os << "\n{\"name\":\"";
+        write_escaped(os, c.name_);
+        //timestamps are in microseconds
+        if (c.end_ == c.begin_)
+            os << "\",\"cat\":\"viz2d\",\"ph\":\"i\",\"s\":\"p\",\"ts\":" << c.begin_ / 1000.0;
+        else
+            os << "\",\"cat\":\"viz2d\",\"ph\":\"X\",\"ts\":" << c.begin_ / 1000.0 << ",\"dur\":" << (c.end_ - c.begin_) / 1000.0;
+        os << ",\"pid\":0,\"tid\":" << c.thread_ << ",\"args\":{\"frame\":" << c.frame_ << "}}";
+    }
+    os << "\n]}" << std::endl;
+}
+
+bool Tracer::writeChromeTrace(const std::string& filename) {
+    std::ofstream ofs(filename);
+    if (!ofs)
+        return false;
+    writeChromeTrace(ofs);
+    return ofs.good();
+}
+} /* namespace viz2d */
+} /* namespace kb */
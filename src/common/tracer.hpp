@@ -0,0 +1,72 @@
+#ifndef SRC_COMMON_TRACER_HPP_
+#define SRC_COMMON_TRACER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace kb {
+namespace viz2d {
+
+/*!
+ * Records timed events into a fixed size ring buffer. Recording is lock-free and can happen from any thread. Old events
+ * are overwritten once the ring is full. The events can be exported as Chrome trace-event JSON (chrome://tracing, Perfetto).
+ */
+class Tracer {
+    struct Event {
+        //index + 1 of the event that was last written completely, 0 while being written
+        std::atomic<uint64_t> seq_ = 0;
+        char name_[32];
+        uint64_t begin_;
+        uint64_t end_;
+        uint64_t frame_;
+        uint32_t thread_;
+    };
+
+    std::unique_ptr<Event[]> ring_;
+    size_t mask_;
+    std::atomic<uint64_t> head_ = 0;
+    std::atomic<uint64_t> frame_ = 0;
+    std::atomic<bool> enabled_ = false;
+    std::chrono::steady_clock::time_point epoch_;
+public:
+    class Scope {
+        Tracer* tracer_;
+        const char* name_;
+        uint64_t begin_ = 0;
+    public:
+        //tracer may be null
+        Scope(Tracer* tracer, const char* name) : tracer_(tracer && tracer->isEnabled() ? tracer : nullptr), name_(name) {
+            if (tracer_)
+                begin_ = tracer_->now();
+        }
+
+        ~Scope() {
+            if (tracer_)
+                tracer_->record(name_, begin_, tracer_->now());
+        }
+    };
+
+    //capacity is rounded up to a power of two
+    Tracer(size_t capacity = 1 << 16);
+    void setEnabled(bool e);
+    bool isEnabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+    //nanoseconds since the tracer was created
+    uint64_t now();
+    //names longer than 31 characters are truncated
+    void record(const char* name, uint64_t begin, uint64_t end);
+    void nextFrame();
+    uint64_t getFrame();
+    void clear();
+    void writeChromeTrace(std::ostream& os);
+    bool writeChromeTrace(const std::string& filename);
+};
+} /* namespace viz2d */
+} /* namespace kb */
+
+#endif /* SRC_COMMON_TRACER_HPP_ */
@@ -2,6 +2,7 @@
 
 #include "viz2d.hpp"
 #include "nvg.hpp"
+#include "framestats.hpp"
 
 namespace kb {
 namespace viz2d {
@@ -41,44 +42,26 @@ void print_system_info() {
 }
 
 void update_fps(cv::Ptr<kb::viz2d::Viz2D> v2d, bool graphically) {
-    static uint64_t cnt = 0;
-    static cv::TickMeter tick;
-    static float fps;
+    //the statistics are ticked by Viz2D::display()
+    FrameStats& stats = v2d->stats();
+    if (stats.getCount() == 0)
+        return;
 
-    if (cnt > 0) {
-        tick.stop();
-
-        if (tick.getTimeMilli() > 50) {
-            cerr << "FPS : " << (fps = tick.getFPS());
+    const FrameStats::Summary& s = stats.getSummary();
+    if (s.frames_ % 15 == 0) {
+        cerr << "FPS : " << s.fps_ << " (p50 " << s.p50_ << "ms, p99 " << s.p99_ << "ms)";
 #ifndef __EMSCRIPTEN__
-            cerr << '\r';
+        cerr << '\r';
 #else
-            cerr << endl;
+        cerr << endl;
 #endif
-            cnt = 0;
-            tick.reset();
-        }
-
-        if (graphically) {
-            v2d->nvg([&](const cv::Size &size) {
-                using namespace kb;
-                string text = "FPS: " + std::to_string(fps);
-                nvg::beginPath();
-                nvg::roundedRect(5, 5, 15 * text.size() + 5, 30, 5);
-                nvg::fillColor(cv::Scalar(255, 255, 255, 180));
-                nvg::fill();
-
-                nvg::fontSize(30.0f);
-                nvg::fontFace("mono");
-                nvg::fillColor(cv::Scalar(90, 90, 90, 255));
-                nvg::textAlign(NVG_ALIGN_LEFT | NVG_ALIGN_MIDDLE);
-                nvg::text(10, 20, text.c_str(), nullptr);
-            });
-        }
     }
 
-    tick.start();
-    ++cnt;
+    if (graphically) {
+        v2d->nvg([&](const cv::Size &size) {
+            stats.draw(5, 5, 360, 100);
+        });
+    }
 }
 
 }
@@ -1,7 +1,17 @@
 #include "viz2d.hpp"
+#include "framegraph.hpp"
+#include "framearena.hpp"
+#include "functionpool.hpp"
+#include "tracer.hpp"
+#include "framestats.hpp"
+#include "qualitycontroller.hpp"
+#include "source.hpp"
+#include "sink.hpp"
 #include "detail/clglcontext.hpp"
 #include "detail/clvacontext.hpp"
 #include "detail/nanovgcontext.hpp"
+#include "detail/captureprefetcher.hpp"
+#include "detail/headlesscontext.hpp"
 
 #ifdef __EMSCRIPTEN__
 #  include <emscripten.h>
@@ -40,6 +50,22 @@ bool contains_absolute(nanogui::Widget* w, const nanogui::Vector2i &p) {
            d.x() < w->size().x() && d.y() < w->size().y();
 }
 
+detail::BufferHandle allocate(const size_t& i, const string& name, const cv::Size& sz, int type, const cv::Scalar& defaultValue, cv::UMatUsageFlags usageFlags) {
+    return detail::store().allocate(i, name, sz, type, defaultValue, usageFlags);
+}
+
+detail::BufferHandle resolve(const size_t& i, const string& name) {
+    return detail::store().resolve(i, name);
+}
+
+void release(const detail::BufferHandle& h) {
+    detail::store().release(h);
+}
+
+cv::UMat& buf(const size_t& i, const string& name) {
+    return detail::store().buf(i, name);
+}
+
 cv::Scalar color_convert(const cv::Scalar& src, cv::ColorConversionCodes code) {
     cv::Mat tmpIn(1,1,CV_8UC3);
     cv::Mat tmpOut(1,1,CV_8UC3);
@@ -153,27 +179,74 @@ bool Viz2DWindow::mouse_drag_event(const nanogui::Vector2i &p, const nanogui::Ve
     return false;
 }
 
-Viz2D::Viz2D(const cv::Size &size, const cv::Size& frameBufferSize, bool offscreen, const string &title, int major, int minor, int samples, bool debug) :
-        initialSize_(size), frameBufferSize_(frameBufferSize), viewport_(0, 0, frameBufferSize.width, frameBufferSize.height), scale_(1), mousePos_(0,0), offscreen_(offscreen), stretch_(false), title_(title), major_(major), minor_(minor), samples_(samples), debug_(debug) {
+Viz2D::Viz2D(const cv::Size &size, const cv::Size& frameBufferSize, bool offscreen, const string &title, int major, int minor, int samples, bool debug, bool headless) :
+        initialSize_(size), frameBufferSize_(frameBufferSize), viewport_(0, 0, frameBufferSize.width, frameBufferSize.height), scale_(1), mousePos_(0,0), windowSize_(frameBufferSize), nativeFrameBufferSize_(frameBufferSize), offscreen_(offscreen || headless), headless_(headless), stretch_(false), title_(title), major_(major), minor_(minor), samples_(samples), debug_(debug) {
+    initialize();
+}
+
+Viz2D::Viz2D(const cv::Size &size, const cv::Size& frameBufferSize, bool offscreen, const string &title, Viz2D& shared) :
+        initialSize_(size), frameBufferSize_(frameBufferSize), viewport_(0, 0, frameBufferSize.width, frameBufferSize.height), scale_(1), mousePos_(0,0), windowSize_(frameBufferSize), nativeFrameBufferSize_(frameBufferSize), offscreen_(offscreen || shared.headless_), headless_(shared.headless_), stretch_(false), title_(title), major_(shared.major_), minor_(shared.minor_), samples_(shared.samples_), debug_(shared.debug_), shared_(&shared) {
+    initialize();
+}
+
+void Viz2D::initialize() {
     assert(frameBufferSize_.width >= initialSize_.width && frameBufferSize_.height >= initialSize_.height);
 
+#ifndef __EMSCRIPTEN__
+    if (headless_) {
+        //there is no window to fall back to. let batch jobs know that they failed.
+        if (!initializeHeadless())
+            CV_Error(cv::Error::StsError, "Unable to create a headless GL context");
+        return;
+    }
+#else
+    //there is no EGL in the browser
+    headless_ = false;
+#endif
     initializeWindowing();
 }
 
 Viz2D::~Viz2D() {
+    //the contexts below have to be destroyed with their own GL context current
+    if (clglContext_)
+        makeCurrent();
+    //joins stages that are still running
+    if (graph_)
+        delete graph_;
+    if (arena_)
+        delete arena_;
+    //make sure all queued frames reach the writer before it is deleted
+    flush();
     //don't delete form_. it is autmatically cleaned up by the base class (nanogui::Screen)
     if(screen_)
         delete screen_;
     if (writer_)
         delete writer_;
+    if (sink_)
+        delete sink_;
+    if (prefetcher_)
+        delete prefetcher_;
     if (capture_)
         delete capture_;
+    if (source_)
+        delete source_;
     if (nvgContext_)
         delete nvgContext_;
     if (clvaContext_)
         delete clvaContext_;
     if (clglContext_)
         delete clglContext_;
+    if (tracer_)
+        delete tracer_;
+    if (stats_)
+        delete stats_;
+    if (quality_)
+        delete quality_;
+#ifndef __EMSCRIPTEN__
+    //last, the contexts above still issue GL calls when they are destroyed
+    if (headlessContext_)
+        delete headlessContext_;
+#endif
 }
 
 bool Viz2D::initializeWindowing() {
@@ -221,11 +294,22 @@ bool Viz2D::initializeWindowing() {
      */
     //    glfwWindowHint(GLFW_DOUBLEBUFFER, GL_FALSE);
 
-    glfwWindow_ = glfwCreateWindow(initialSize_.width, initialSize_.height, title_.c_str(), nullptr, nullptr);
+    glfwWindow_ = glfwCreateWindow(initialSize_.width, initialSize_.height, title_.c_str(), nullptr, shared_ ? shared_->getGLFWWindow() : nullptr);
     if (glfwWindow_ == NULL) {
         return false;
     }
-    glfwMakeContextCurrent(getGLFWWindow());
+    makeCurrent();
+
+    {
+        int w, h;
+        glfwGetWindowSize(getGLFWWindow(), &w, &h);
+        windowSize_ = cv::Size(w, h);
+        glfwGetFramebufferSize(getGLFWWindow(), &w, &h);
+        nativeFrameBufferSize_ = cv::Size(w, h);
+#ifndef __EMSCRIPTEN__
+        glfwGetWindowContentScale(getGLFWWindow(), &pixelRatio_[0], &pixelRatio_[1]);
+#endif
+    }
 
     screen_ = new nanogui::Screen();
     screen().initialize(getGLFWWindow(), false);
@@ -273,8 +357,8 @@ bool Viz2D::initializeWindowing() {
         Viz2D* v2d = reinterpret_cast<Viz2D*>(glfwGetWindowUserPointer(glfwWin));
         std::vector<nanogui::Widget*> widgets;
         find_widgets(&v2d->screen(), widgets);
+        auto mousePos = nanogui::Vector2i(v2d->getMousePosition()[0] / v2d->getXPixelRatio(), v2d->getMousePosition()[1] / v2d->getYPixelRatio());
         for(auto* w : widgets) {
-            auto mousePos = nanogui::Vector2i(v2d->getMousePosition()[0] / v2d->getXPixelRatio(), v2d->getMousePosition()[1] / v2d->getYPixelRatio());
             if(contains_absolute(w, mousePos)) {
                 v2d->screen().scroll_callback_event(x, y);
                 return;
@@ -286,24 +370,51 @@ bool Viz2D::initializeWindowing() {
     );
 
 //FIXME resize internal buffers?
-//    glfwSetWindowContentScaleCallback(getGLFWWindow(),
-//        [](GLFWwindow* glfwWin, float xscale, float yscale) {
-//        }
-//    );
+    glfwSetWindowContentScaleCallback(getGLFWWindow(), [](GLFWwindow* glfwWin, float xscale, float yscale) {
+        Viz2D* v2d = reinterpret_cast<Viz2D*>(glfwGetWindowUserPointer(glfwWin));
+        v2d->pixelRatio_ = {xscale, yscale};
+    }
+    );
+
+    glfwSetWindowSizeCallback(getGLFWWindow(), [](GLFWwindow* glfwWin, int width, int height) {
+        Viz2D* v2d = reinterpret_cast<Viz2D*>(glfwGetWindowUserPointer(glfwWin));
+        v2d->windowSize_ = cv::Size(width, height);
+    }
+    );
 
     glfwSetFramebufferSizeCallback(getGLFWWindow(), [](GLFWwindow *glfwWin, int width, int height) {
         Viz2D* v2d = reinterpret_cast<Viz2D*>(glfwGetWindowUserPointer(glfwWin));
+        v2d->nativeFrameBufferSize_ = cv::Size(width, height);
         v2d->screen().resize_callback_event(width, height);
     }
     );
 
-    clglContext_ = new detail::CLGLContext(this->getFrameBufferSize());
+    initializeContexts();
+    return true;
+}
+
+bool Viz2D::initializeHeadless() {
+#ifndef __EMSCRIPTEN__
+    headlessContext_ = new detail::HeadlessContext(major_, minor_, debug_, shared_ ? shared_->headlessContext_ : nullptr);
+    if (!headlessContext_->isValid())
+        return false;
+
+    makeCurrent();
+    initializeContexts();
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Viz2D::initializeContexts() {
+    clglContext_ = new detail::CLGLContext(this->getFrameBufferSize(), shared_ ? shared_->clglContext_ : nullptr);
     clvaContext_ = new detail::CLVAContext(*clglContext_);
     nvgContext_ = new detail::NanoVGContext(*this, getNVGcontext(), *clglContext_);
-    return true;
 }
 
 cv::ogl::Texture2D& Viz2D::texture() {
+    clgl().syncToGL();
     return clglContext_->getTexture2D();
 }
 
@@ -361,6 +472,7 @@ void Viz2D::setVideoFrameSize(const cv::Size& sz) {
 }
 
 void Viz2D::gl(std::function<void(const cv::Size&)> fn) {
+    Tracer::Scope trace(tracer_, "gl");
     auto fbSize = getFrameBufferSize();
 #ifndef __EMSCRIPTEN__
     detail::CLExecScope_t scope(clgl().getCLExecContext());
@@ -370,48 +482,156 @@ void Viz2D::gl(std::function<void(const cv::Size&)> fn) {
 }
 
 void Viz2D::cl(std::function<void()> fn) {
+    Tracer::Scope trace(tracer_, "cl");
 #ifndef __EMSCRIPTEN__
     detail::CLExecScope_t scope(clgl().getCLExecContext());
 #endif
     fn();
 }
 
-void Viz2D::cpu(std::function<void()> fn) {
-    cv::ocl::setUseOpenCL(false);
-    fn();
-    cv::ocl::setUseOpenCL(true);
+std::future<void> Viz2D::cpu(std::function<void()> fn) {
+    return pool().push(fn);
 }
 
-void Viz2D::clgl(std::function<void(cv::UMat&)> fn) {
-    clgl().execute(fn);
+void Viz2D::clgl(std::function<void(cv::UMat&)> fn, cv::AccessFlag access) {
+    Tracer::Scope trace(tracer_, "clgl");
+    clgl().execute(fn, access);
 }
 
 void Viz2D::nvg(std::function<void(const cv::Size&)> fn) {
+    Tracer::Scope trace(tracer_, "nvg");
     nvg().render(fn);
 }
 
+Viz2D* Viz2D::getShareRoot() {
+    return shared_ ? shared_->getShareRoot() : this;
+}
+
+void Viz2D::blitFrom(Viz2D& source) {
+    assert(getShareRoot() == source.getShareRoot());
+    //GL reads the texture, so it has to be up to date
+    source.clgl().syncToGL();
+    clgl().blitFrom(*source.clglContext_);
+}
+
+FrameGraph& Viz2D::graph() {
+    if (!graph_)
+        graph_ = new FrameGraph(*this);
+    return *graph_;
+}
+
+FrameArena& Viz2D::arena() {
+    if (!arena_)
+        arena_ = new FrameArena();
+    return *arena_;
+}
+
+FrameStats& Viz2D::stats() {
+    if (!stats_)
+        stats_ = new FrameStats();
+    return *stats_;
+}
+
+QualityController& Viz2D::quality() {
+    if (!quality_)
+        quality_ = new QualityController();
+    return *quality_;
+}
+
+Tracer& Viz2D::tracer() {
+    if (!tracer_) {
+        tracer_ = new Tracer();
+        clglContext_->tracer_ = tracer_;
+    }
+    return *tracer_;
+}
+
 bool Viz2D::capture() {
+    Tracer::Scope trace(tracer_, "capture");
+    if (prefetchDepth_ > 0) {
+        if (prefetcher_ == nullptr) {
+            prefetcher_ = new detail::CapturePrefetcher([=, this](cv::UMat &videoFrame) {
+                this->read(videoFrame);
+                return !videoFrame.empty();
+            }, prefetchDepth_, clva().hasContext() ? clva().getCLExecContext() : clgl().getCLExecContext());
+        }
+
+        return clva().capture([=, this](cv::UMat &videoFrame) {
+            this->prefetcher_->pop(videoFrame);
+        });
+    }
+
     return clva().capture([=, this](cv::UMat &videoFrame) {
-        *(this->capture_) >> videoFrame;
+        this->read(videoFrame);
     });
 }
 
+void Viz2D::read(cv::UMat& videoFrame) {
+    if (source_) {
+        if (!source_->read(videoFrame))
+            videoFrame.release();
+    } else {
+        *capture_ >> videoFrame;
+    }
+}
+
 bool Viz2D::capture(std::function<void(cv::UMat&)> fn) {
+    Tracer::Scope trace(tracer_, "capture");
     return clva().capture(fn);
 }
 
 void Viz2D::write() {
+    Tracer::Scope trace(tracer_, "write");
     clva().write([=, this](const cv::UMat &videoFrame) {
-        *(this->writer_) << videoFrame;
+        this->writeFrame(videoFrame);
     });
 }
 
+void Viz2D::writeFrame(const cv::UMat& videoFrame) {
+    if (sink_)
+        sink_->write(videoFrame);
+    else
+        *writer_ << videoFrame;
+}
+
 void Viz2D::write(std::function<void(const cv::UMat&)> fn) {
+    Tracer::Scope trace(tracer_, "write");
     clva().write(fn);
 }
 
+void Viz2D::setAsyncWrite(size_t queueDepth, WriterPolicy policy) {
+    clva().setAsyncWriter(queueDepth, policy == DROP_WHEN_FULL);
+}
+
+void Viz2D::flush() {
+    if (clvaContext_)
+        clvaContext_->flush();
+}
+
+void Viz2D::setPrefetchDepth(size_t depth) {
+    //frames that have already been decoded are dropped, so better set it before the first capture.
+    if (prefetcher_) {
+        delete prefetcher_;
+        prefetcher_ = nullptr;
+    }
+    prefetchDepth_ = depth;
+}
+
+size_t Viz2D::getPrefetchDepth() {
+    return prefetchDepth_;
+}
+
 void Viz2D::makeCurrent() {
-    glfwMakeContextCurrent(getGLFWWindow());
+#ifndef __EMSCRIPTEN__
+    //ask GLFW and EGL instead of caching. nanogui and other threads switch contexts behind our back.
+    if (headlessContext_) {
+        if (!headlessContext_->isCurrent())
+            headlessContext_->makeCurrent();
+        return;
+    }
+#endif
+    if (glfwGetCurrentContext() != glfwWindow_)
+        glfwMakeContextCurrent(getGLFWWindow());
 }
 #ifndef __EMSCRIPTEN__
 cv::VideoWriter& Viz2D::makeVAWriter(const string &outputFilename, const int fourcc, const float fps, const cv::Size &frameSize, const int vaDeviceIndex) {
@@ -461,6 +681,26 @@ cv::VideoCapture& Viz2D::makeCapture(const string &inputFilename) {
 }
 #endif
 
+void Viz2D::setSource(Source* source) {
+    if (prefetcher_) {
+        delete prefetcher_;
+        prefetcher_ = nullptr;
+    }
+    if (source_)
+        delete source_;
+    source_ = source;
+    setVideoFrameSize(source->getSize());
+}
+
+void Viz2D::setSink(Sink* sink) {
+    //queued frames still go to the old sink
+    flush();
+    if (sink_)
+        delete sink_;
+    sink_ = sink;
+    setVideoFrameSize(sink->getSize());
+}
+
 void Viz2D::clear(const cv::Scalar &rgba) {
     const float &r = rgba[0] / 255.0f;
     const float &g = rgba[1] / 255.0f;
@@ -543,6 +783,8 @@ void Viz2D::zoom(float factor) {
 }
 
 cv::Vec2f Viz2D::getPosition() {
+    if (headless_)
+        return {0, 0};
     makeCurrent();
     int x, y;
     glfwGetWindowPos(getGLFWWindow(), &x, &y);
@@ -566,10 +808,7 @@ cv::Rect Viz2D::getViewport() {
 }
 
 cv::Size Viz2D::getNativeFrameBufferSize() {
-    makeCurrent();
-    int w, h;
-    glfwGetFramebufferSize(getGLFWWindow(), &w, &h);
-    return {w, h};
+    return nativeFrameBufferSize_;
 }
 
 cv::Size Viz2D::getFrameBufferSize() {
@@ -577,10 +816,7 @@ cv::Size Viz2D::getFrameBufferSize() {
 }
 
 cv::Size Viz2D::getWindowSize() {
-    makeCurrent();
-    int w, h;
-    glfwGetWindowSize(getGLFWWindow(), &w, &h);
-    return {w, h};
+    return windowSize_;
 }
 
 cv::Size Viz2D::getInitialSize() {
@@ -588,38 +824,38 @@ cv::Size Viz2D::getInitialSize() {
 }
 
 float Viz2D::getXPixelRatio() {
-    makeCurrent();
 #ifdef __EMSCRIPTEN__
-    return emscripten_get_device_pixel_ratio();
-#else
-    float xscale, yscale;
-    glfwGetWindowContentScale(getGLFWWindow(), &xscale, &yscale);
-    return xscale;
+    if (!headless_)
+        return emscripten_get_device_pixel_ratio();
 #endif
+    return pixelRatio_[0];
 }
 
 float Viz2D::getYPixelRatio() {
-    makeCurrent();
 #ifdef __EMSCRIPTEN__
-    return emscripten_get_device_pixel_ratio();
-#else
-    float xscale, yscale;
-    glfwGetWindowContentScale(getGLFWWindow(), &xscale, &yscale);
-    return yscale;
+    if (!headless_)
+        return emscripten_get_device_pixel_ratio();
 #endif
+    return pixelRatio_[1];
 }
 
 void Viz2D::setWindowSize(const cv::Size &sz) {
+    if (headless_)
+        return;
     makeCurrent();
     screen().set_size(nanogui::Vector2i(sz.width / getXPixelRatio(), sz.height / getYPixelRatio()));
 }
 
 bool Viz2D::isFullscreen() {
+    if (headless_)
+        return false;
     makeCurrent();
     return glfwGetWindowMonitor(getGLFWWindow()) != nullptr;
 }
 
 void Viz2D::setFullscreen(bool f) {
+    if (headless_)
+        return;
     makeCurrent();
     auto monitor = glfwGetPrimaryMonitor();
     const GLFWvidmode *mode = glfwGetVideoMode(monitor);
@@ -633,6 +869,8 @@ void Viz2D::setFullscreen(bool f) {
 }
 
 bool Viz2D::isResizable() {
+    if (headless_)
+        return false;
     makeCurrent();
     return glfwGetWindowAttrib(getGLFWWindow(), GLFW_RESIZABLE) == GLFW_TRUE;
 }
@@ -642,10 +880,14 @@ void Viz2D::setResizable(bool r) {
 }
 
 bool Viz2D::isVisible() {
+    if (headless_)
+        return false;
     return glfwGetWindowAttrib(getGLFWWindow(), GLFW_VISIBLE) == GLFW_TRUE;
 }
 
 void Viz2D::setVisible(bool v) {
+    if (headless_)
+        return;
     makeCurrent();
     glfwWindowHint(GLFW_VISIBLE, v ? GLFW_TRUE : GLFW_FALSE);
     screen().set_visible(v);
@@ -657,8 +899,16 @@ bool Viz2D::isOffscreen() {
     return offscreen_;
 }
 
+bool Viz2D::isHeadless() {
+    return headless_;
+}
+
 void Viz2D::setOffscreen(bool o) {
+    //there is nothing to show
+    if (headless_)
+        return;
     offscreen_ = o;
+    presentDecided_ = false;
     setVisible(!o);
 }
 
@@ -720,6 +970,7 @@ void Viz2D::setAccelerated(bool a) {
         double fps = 0;
         double fourcc = 0;
 
+        flush();
         if(writer_) {
             w = writer_->get(cv::CAP_PROP_FRAME_WIDTH);
             h = writer_->get(cv::CAP_PROP_FRAME_HEIGHT);
@@ -727,6 +978,11 @@ void Viz2D::setAccelerated(bool a) {
             fourcc = writer_->get(cv::CAP_PROP_FOURCC);
         }
 
+        if(prefetcher_) {
+            delete prefetcher_;
+            prefetcher_ = nullptr;
+        }
+
         if(a) {
             if(capture_) {
                 delete capture_;
@@ -751,9 +1007,50 @@ void Viz2D::setAccelerated(bool a) {
 #endif
 }
 
+bool Viz2D::isFenceSync() {
+    return clgl().isFenceSync();
+}
+
+void Viz2D::setFenceSync(bool f) {
+    clgl().setFenceSync(f);
+}
+
+void Viz2D::setDisplayRate(float fps) {
+    displayRate_ = std::max(fps, 0.0f);
+    presentDecided_ = false;
+    if (!offscreen_ && !headless_) {
+        makeCurrent();
+        //with a display rate the swap must not block on vsync
+        glfwSwapInterval(displayRate_ > 0 ? 0 : 1);
+    }
+}
+
+float Viz2D::getDisplayRate() {
+    return displayRate_;
+}
+
+bool Viz2D::willPresent() {
+    if (!presentDecided_) {
+        present_ = !offscreen_ && (displayRate_ <= 0 || std::chrono::duration<float>(std::chrono::steady_clock::now() - lastPresent_).count() >= 1.0f / displayRate_);
+        presentDecided_ = true;
+    }
+    return present_;
+}
+
 bool Viz2D::display() {
     bool result = true;
-    if (!offscreen_) {
+    bool present = willPresent();
+    presentDecided_ = false;
+    if (!offscreen_ && !present) {
+        //not shown, so it only costs handling the events. the window has to stay responsive.
+        glfwPollEvents();
+        result = !glfwWindowShouldClose(glfwWindow_);
+    } else if (present && displayRate_ > 0) {
+        lastPresent_ = std::chrono::steady_clock::now();
+    }
+
+    if (present) {
+        Tracer::Scope trace(tracer_, "display");
         makeCurrent();
         glfwPollEvents();
         screen().draw_contents();
@@ -763,6 +1060,16 @@ bool Viz2D::display() {
         result = !glfwWindowShouldClose(glfwWindow_);
     }
 
+    //temporaries of this frame can be reused by the next one
+    if (arena_)
+        arena_->recycle();
+    if (tracer_)
+        tracer_->nextFrame();
+    if (stats_)
+        stats_->tick();
+    if (quality_)
+        quality_->update();
+
     return result;
 }
 
@@ -780,6 +1087,10 @@ GLFWwindow* Viz2D::getGLFWWindow() {
 }
 
 NVGcontext* Viz2D::getNVGcontext() {
+#ifndef __EMSCRIPTEN__
+    if (headlessContext_)
+        return headlessContext_->getNVGcontext();
+#endif
     return screen().nvg_context();
 }
 }
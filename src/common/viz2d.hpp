@@ -1,13 +1,16 @@
 #ifndef SRC_COMMON_VIZ2D_HPP_
 #define SRC_COMMON_VIZ2D_HPP_
 
+#include <chrono>
 #include <filesystem>
+#include <future>
 #include <iostream>
 #include <set>
 #include <string>
 #include <opencv2/opencv.hpp>
 #include <opencv2/videoio.hpp>
 #include <nanogui/nanogui.h>
+#include "detail/bufferstore.hpp"
 #ifndef __EMSCRIPTEN__
 #include <GL/glew.h>
 #else
@@ -27,6 +30,8 @@ namespace detail {
 class CLGLContext;
 class CLVAContext;
 class NanoVGContext;
+class CapturePrefetcher;
+class HeadlessContext;
 
 void gl_check_error(const std::filesystem::path &file, unsigned int line, const char *expression);
 
@@ -35,57 +40,29 @@ void gl_check_error(const std::filesystem::path &file, unsigned int line, const
     kb::viz2d::gl_check_error(__FILE__, __LINE__, #expr);
 
 void error_callback(int error, const char *description);
-
-class BufferStore {
-    std::map<size_t, std::map<string, cv::UMat>> bufMap_;
-    std::map<size_t, std::map<string, void*>> varMap_;
-    std::map<string, cv::UMat>& getBufMap(const size_t& i) {
-        return bufMap_[i];
-    }
-
-    std::map<string, void*>& getVarMap(const size_t& i) {
-        return varMap_[i];
-    }
-
-public:
-    void allocate(const size_t& i, const string& name, const cv::Size& sz, int type, const cv::Scalar& defaultValue, cv::UMatUsageFlags usageFlags = cv::USAGE_DEFAULT) {
-        getBufMap(i)[name].create(sz, type, usageFlags);
-    }
-
-    cv::UMat& buf(const size_t& i, const string& name) {
-        std::stringstream ss;
-        return getBufMap(i)[name];
-    }
-
-    template <typename T> T& var(const size_t& i, const string& name) {
-        auto it = getVarMap(i).find(name);
-        if(it != getVarMap(i).end()) {
-            return *static_cast<T*>((*it).second);
-        } else {
-            auto* p = new T();
-            getVarMap(i)[name] = p;
-            return *p;
-        }
-    }
-};
-
-static BufferStore store;
 }
 
-static void allocate(const size_t& i, const string& name, const cv::Size& sz, int type, const cv::Scalar& defaultValue, cv::UMatUsageFlags usageFlags = cv::USAGE_DEFAULT) {
-    detail::store.allocate(i, name, sz, type, defaultValue, usageFlags);
-}
+detail::BufferHandle allocate(const size_t& i, const string& name, const cv::Size& sz, int type, const cv::Scalar& defaultValue, cv::UMatUsageFlags usageFlags = cv::USAGE_DEFAULT);
+detail::BufferHandle resolve(const size_t& i, const string& name);
+void release(const detail::BufferHandle& h);
+cv::UMat& buf(const size_t& i, const string& name);
 
-static cv::UMat& buf(const size_t& i, const string& name) {
-    return detail::store.buf(i, name);
+inline cv::UMat& buf(const detail::BufferHandle& h) {
+    return detail::store().buf(h);
 }
 
 template <typename T> T& var(const size_t& i, const string& name) {
-    return detail::store.var<T>(i, name);
+    return detail::store().var<T>(i, name);
 }
 
 cv::Scalar color_convert(const cv::Scalar& src, cv::ColorConversionCodes code);
 
+//What the asynchronous writer does when its queue is full
+enum WriterPolicy {
+    BLOCK_WHEN_FULL,
+    DROP_WHEN_FULL
+};
+
 using namespace kb::viz2d::detail;
 
 class Viz2DWindow : public nanogui::Window {
@@ -108,15 +85,28 @@ public:
 };
 
 class NVG;
+class FrameGraph;
+class FrameArena;
+class Tracer;
+class FrameStats;
+class QualityController;
+class Source;
+class Sink;
 
 class Viz2D {
     friend class NanoVGContext;
+    friend class FrameGraph;
     const cv::Size initialSize_;
     cv::Size frameBufferSize_;
     cv::Rect viewport_;
     float scale_;
     cv::Vec2f mousePos_;
+    //cached from glfw callbacks, so the getters don't have to query glfw every time
+    cv::Size windowSize_;
+    cv::Size nativeFrameBufferSize_;
+    cv::Vec2f pixelRatio_ = {1, 1};
     bool offscreen_;
+    bool headless_;
     bool stretch_;
     string title_;
     int major_;
@@ -126,11 +116,23 @@ class Viz2D {
     std::filesystem::path capturePath_;
     std::filesystem::path writerPath_;
     GLFWwindow* glfwWindow_ = nullptr;
+    HeadlessContext* headlessContext_ = nullptr;
+    //the instance this one shares its GL objects and OpenCL context with
+    Viz2D* shared_ = nullptr;
     CLGLContext* clglContext_ = nullptr;
     CLVAContext* clvaContext_ = nullptr;
     NanoVGContext* nvgContext_ = nullptr;
     cv::VideoCapture* capture_ = nullptr;
+    Source* source_ = nullptr;
+    Sink* sink_ = nullptr;
     cv::VideoWriter* writer_ = nullptr;
+    CapturePrefetcher* prefetcher_ = nullptr;
+    size_t prefetchDepth_ = 0;
+    FrameGraph* graph_ = nullptr;
+    FrameArena* arena_ = nullptr;
+    Tracer* tracer_ = nullptr;
+    FrameStats* stats_ = nullptr;
+    QualityController* quality_ = nullptr;
     nanogui::FormHelper* form_ = nullptr;
     bool closed_ = false;
     cv::Size videoFrameSize_ = cv::Size(0,0);
@@ -138,29 +140,59 @@ class Viz2D {
     int vaWriterDeviceIndex_ = 0;
     bool mouseDrag_ = false;
     nanogui::Screen* screen_ = nullptr;
+    //0 presents every frame
+    float displayRate_ = 0;
+    std::chrono::steady_clock::time_point lastPresent_;
+    //the decision of willPresent() holds until the next display()
+    bool presentDecided_ = false;
+    bool present_ = false;
 public:
-    Viz2D(const cv::Size &initialSize, const cv::Size& frameBufferSize, bool offscreen, const string &title, int major = 4, int minor = 6, int samples = 0, bool debug = false);
+    //headless instances render into an EGL context without window, GLFW or nanogui. they are always offscreen.
+    Viz2D(const cv::Size &initialSize, const cv::Size& frameBufferSize, bool offscreen, const string &title, int major = 4, int minor = 6, int samples = 0, bool debug = false, bool headless = false);
+    //shares GL objects and the OpenCL context with shared, which has to outlive this instance. version, samples, debug and headless are taken from shared.
+    Viz2D(const cv::Size &initialSize, const cv::Size& frameBufferSize, bool offscreen, const string &title, Viz2D& shared);
     virtual ~Viz2D();
     bool initializeWindowing();
+    bool initializeHeadless();
     void makeCurrent();
 
     cv::ogl::Texture2D& texture();
 
     void gl(std::function<void(const cv::Size&)> fn);
     void cl(std::function<void()> fn);
-    void cpu(std::function<void()> fn);
-    void clgl(std::function<void(cv::UMat&)> fn);
+    //runs fn on the shared worker pool without OpenCL
+    std::future<void> cpu(std::function<void()> fn);
+    //access tells whether fn reads and/or writes the framebuffer. read-only stages don't cause an upload to GL.
+    void clgl(std::function<void(cv::UMat&)> fn, cv::AccessFlag access = cv::ACCESS_RW);
     void nvg(std::function<void(const cv::Size&)> fn);
+    FrameGraph& graph();
+    //scales the framebuffer of an instance of the same share group into this one. no copy through OpenCL or the host.
+    void blitFrom(Viz2D& source);
+    FrameArena& arena();
+    //instrumentation of all stages. created on first use and disabled until Tracer::setEnabled(true).
+    Tracer& tracer();
+    //frame time statistics. created on first use and ticked by display().
+    FrameStats& stats();
+    //adjusts quality knobs to a frame time budget. created on first use, measures the stages of graph() and is updated by display().
+    QualityController& quality();
 
     void clear(const cv::Scalar& rgba = cv::Scalar(0,0,0,255));
     bool capture();
     bool capture(std::function<void(cv::UMat&)> fn);
     void write();
     void write(std::function<void(const cv::UMat&)> fn);
+    void setAsyncWrite(size_t queueDepth, WriterPolicy policy = BLOCK_WHEN_FULL);
+    void flush();
     cv::VideoWriter& makeVAWriter(const string& outputFilename, const int fourcc, const float fps, const cv::Size& frameSize, const int vaDeviceIndex);
     cv::VideoCapture& makeVACapture(const string& intputFilename, const int vaDeviceIndex);
     cv::VideoWriter& makeWriter(const string& outputFilename, const int fourcc, const float fps, const cv::Size& frameSize);
     cv::VideoCapture& makeCapture(const string& intputFilename);
+    //captures from source instead of a cv::VideoCapture. takes ownership of source.
+    void setSource(Source* source);
+    //writes to sink instead of a cv::VideoWriter. takes ownership of sink.
+    void setSink(Sink* sink);
+    void setPrefetchDepth(size_t depth);
+    size_t getPrefetchDepth();
     void setMouseDrag(bool d);
     bool isMouseDrag();
     void pan(int x, int y);
@@ -185,14 +217,24 @@ public:
     bool isVisible();
     void setVisible(bool v);
     bool isOffscreen();
+    bool isHeadless();
     void setOffscreen(bool o);
     void setStretching(bool s);
     bool isStretching();
     bool isClosed();
     bool isAccelerated();
     void setAccelerated(bool u);
+    bool isFenceSync();
+    void setFenceSync(bool f);
     void close();
     bool display();
+    //presents at most fps frames per second without waiting for vsync. display() returns right away for the frames in
+    //between, so the pipeline isn't throttled by the monitor. 0 presents every frame (the default).
+    void setDisplayRate(float fps);
+    float getDisplayRate();
+    //true if the next display() presents. work that only feeds the window, like a blitFrom(), can be skipped otherwise.
+    //the answer is decided once per frame, display() follows it.
+    bool willPresent();
 
     Viz2DWindow* makeWindow(int x, int y, const string& title);
     nanogui::Label* makeGroup(const string& label);
@@ -222,6 +264,12 @@ public:
 private:
     virtual bool keyboard_event(int key, int scancode, int action, int modifiers);
     void setMousePosition(int x, int y);
+    void initialize();
+    void initializeContexts();
+    //reads the next frame from the source or the capture. empty at the end of the stream.
+    void read(cv::UMat& videoFrame);
+    void writeFrame(const cv::UMat& videoFrame);
+    Viz2D* getShareRoot();
     nanogui::FormHelper* form();
     CLGLContext& clgl();
     CLVAContext& clva();
@@ -22,6 +22,7 @@ const unsigned long DIAG = hypot(double(WIDTH), double(HEIGHT));
 constexpr bool OFFSCREEN = false;
 constexpr const char* OUTPUT_FILENAME = "font-demo.mkv";
 constexpr const int VA_HW_DEVICE_INDEX = 0;
+constexpr size_t WRITER_QUEUE_DEPTH = 3;
 constexpr double FPS = 60;
 const cv::Scalar_<float> INITIAL_COLOR = kb::viz2d::color_convert(cv::Scalar(0.15 * 180.0, 128, 255, 255), cv::COLOR_HLS2BGR);
 /** Visualization parameters **/
@@ -216,6 +217,7 @@ int main(int argc, char **argv) {
     }
 #ifndef __EMSCRIPTEN__
     v2d->makeVAWriter(OUTPUT_FILENAME, cv::VideoWriter::fourcc('V', 'P', '9', '0'), FPS, v2d->getFrameBufferSize(), VA_HW_DEVICE_INDEX);
+    v2d->setAsyncWrite(WRITER_QUEUE_DEPTH);
 #endif
 
     //The text to display
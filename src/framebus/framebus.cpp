@@ -0,0 +1,70 @@
+#include "../common/framebus.hpp"
+
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <opencv2/videoio.hpp>
+
+using std::cerr;
+using std::endl;
+using std::string;
+
+constexpr size_t DEFAULT_SLOTS = 4;
+
+static volatile std::sig_atomic_t running = 1;
+
+static void stop(int) {
+    running = 0;
+}
+
+//Decodes a video once and publishes the frames on a shared memory frame bus for the demos to consume (bus:<name>).
+int main(int argc, char **argv) {
+    bool unpaced = argc > 1 && string(argv[argc - 1]) == "--unpaced";
+    int args = unpaced ? argc - 1 : argc;
+    if (args != 3 && args != 4) {
+        cerr << "Usage: framebus <input-video-file> <bus-name> [<slots>] [--unpaced]" << endl;
+        cerr << "Publishes at the frame rate of the input unless --unpaced is given." << endl;
+        exit(1);
+    }
+
+    cv::VideoCapture capture(argv[1], cv::CAP_FFMPEG);
+    if (!capture.isOpened()) {
+        cerr << "ERROR! Unable to open video input" << endl;
+        exit(-1);
+    }
+
+    float fps = capture.get(cv::CAP_PROP_FPS);
+    cv::Size size(capture.get(cv::CAP_PROP_FRAME_WIDTH), capture.get(cv::CAP_PROP_FRAME_HEIGHT));
+    kb::viz2d::FrameBusPublisher bus(argv[2], size, CV_8UC3, fps, args == 4 ? std::stoul(argv[3]) : DEFAULT_SLOTS);
+    if (!bus.isOpened())
+        exit(-1);
+
+    //the bus has to be removed on ctrl-c
+    std::signal(SIGINT, stop);
+    std::signal(SIGTERM, stop);
+
+    auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(fps > 0 ? 1.0 / fps : 0));
+    auto next = std::chrono::steady_clock::now();
+    cv::Mat frame;
+    bool failed = false;
+    while (running && capture.read(frame) && !frame.empty()) {
+        if (!unpaced) {
+            std::this_thread::sleep_until(next);
+            next += interval;
+        }
+        //e.g. a frame of another size than the first one. returning destroys the bus.
+        if (!bus.publish(frame)) {
+            cerr << endl << "ERROR! Unable to publish frame " << bus.getPublished() << " of size " << frame.size() << endl;
+            failed = true;
+            break;
+        }
+        if (bus.getPublished() % 100 == 0)
+            cerr << "Published: " << bus.getPublished() << '\r';
+    }
+    cerr << "Published: " << bus.getPublished() << endl;
+
+    return failed ? -1 : 0;
+}
@@ -9,6 +9,8 @@ constexpr unsigned int HEIGHT = 1080;
 constexpr bool OFFSCREEN = false;
 constexpr const char *OUTPUT_FILENAME = "nanovg-demo.mkv";
 constexpr const int VA_HW_DEVICE_INDEX = 0;
+constexpr size_t PREFETCH_DEPTH = 3;
+constexpr size_t WRITER_QUEUE_DEPTH = 3;
 
 using std::cerr;
 using std::endl;
@@ -128,6 +130,7 @@ int main(int argc, char **argv) {
         v2d->setVisible(true);
 
     auto capture = v2d->makeVACapture(argv[1], VA_HW_DEVICE_INDEX);
+    v2d->setPrefetchDepth(PREFETCH_DEPTH);
     if (!capture.isOpened()) {
         cerr << "ERROR! Unable to open video input" << endl;
         exit(-1);
@@ -137,6 +140,7 @@ int main(int argc, char **argv) {
     float width = capture.get(cv::CAP_PROP_FRAME_WIDTH);
     float height = capture.get(cv::CAP_PROP_FRAME_HEIGHT);
     v2d->makeVAWriter(OUTPUT_FILENAME, cv::VideoWriter::fourcc('V', 'P', '9', '0'), fps, cv::Size(width, height), VA_HW_DEVICE_INDEX);
+    v2d->setAsyncWrite(WRITER_QUEUE_DEPTH);
 
     cv::UMat rgb;
     cv::UMat bgra;
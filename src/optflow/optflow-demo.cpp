@@ -3,15 +3,23 @@
 #include "../common/viz2d.hpp"
 #include "../common/nvg.hpp"
 #include "../common/util.hpp"
+#include "../common/framearena.hpp"
+#include "../common/effects.hpp"
+#include "../common/analysis.hpp"
+#include "../common/framegraph.hpp"
+#include "../common/functionpool.hpp"
+#include "../common/syntheticsource.hpp"
+#include "../common/pipeio.hpp"
+#include "../common/framecache.hpp"
+#include "../common/framebus.hpp"
+#include "../common/qualitycontroller.hpp"
 
 #include <cmath>
 #include <vector>
 #include <set>
 #include <string>
 #include <thread>
-#include <random>
 
-#include <opencv2/features2d.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/optflow.hpp>
@@ -23,18 +31,10 @@ using std::vector;
 using std::string;
 using namespace std::literals::chrono_literals;
 
-enum BackgroundModes {
-    GREY,
-    COLOR,
-    VALUE,
-    BLACK
-};
-
-enum PostProcModes {
-    GLOW,
-    BLOOM,
-    NONE
-};
+using kb::viz2d::BackgroundModes;
+using kb::viz2d::PostProcModes;
+using enum kb::viz2d::BackgroundModes;
+using enum kb::viz2d::PostProcModes;
 
 /** Application parameters **/
 
@@ -49,10 +49,17 @@ const unsigned long DIAG = hypot(double(WIDTH), double(HEIGHT));
 constexpr const char* OUTPUT_FILENAME = "optflow-demo.mkv";
 constexpr bool OFFSCREEN = false;
 constexpr int VA_HW_DEVICE_INDEX = 0;
+constexpr size_t PREFETCH_DEPTH = 3;
+constexpr size_t WRITER_QUEUE_DEPTH = 3;
+//the window is refreshed at this rate while the pipeline runs as fast as it can. 0 shows every frame.
+constexpr float DISPLAY_RATE = 30;
+//frames between the scene cuts of the synthetic input
+constexpr size_t SYNTHETIC_SCENE_LENGTH = 300;
 
 static cv::Ptr<kb::viz2d::Viz2D> v2d = new kb::viz2d::Viz2D(cv::Size(WIDTH, HEIGHT), cv::Size(WIDTH, HEIGHT), OFFSCREEN, "Sparse Optical Flow Demo");
 #ifndef __EMSCRIPTEN__
-static cv::Ptr<kb::viz2d::Viz2D> v2dMenu = new kb::viz2d::Viz2D(cv::Size(240, 360), cv::Size(240,360), false, "Display Settings");
+//shares the GL objects and the OpenCL context of v2d
+static cv::Ptr<kb::viz2d::Viz2D> v2dMenu = new kb::viz2d::Viz2D(cv::Size(240, 360), cv::Size(240,360), false, "Display Settings", *v2d);
 #else
 #  include <emscripten.h>
 #  include <emscripten/bind.h>
@@ -153,192 +160,49 @@ int kernel_size = std::max(int(DIAG / 100 % 2 == 0 ? DIAG / 100 + 1 : DIAG / 100
 int bloom_thresh = 210;
 //The intensity of the bloom filter
 float bloom_gain = 3;
-
-void prepare_motion_mask(const cv::UMat& srcGrey, cv::UMat& motionMaskGrey) {
-    static cv::Ptr<cv::BackgroundSubtractor> bg_subtrator = cv::createBackgroundSubtractorMOG2(100, 16.0, false);
-    static int morph_size = 1;
-    static cv::Mat element = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2 * morph_size + 1, 2 * morph_size + 1), cv::Point(morph_size, morph_size));
-
-    bg_subtrator->apply(srcGrey, motionMaskGrey);
-    cv::morphologyEx(motionMaskGrey, motionMaskGrey, cv::MORPH_OPEN, element, cv::Point(element.cols >> 1, element.rows >> 1), 2, cv::BORDER_CONSTANT, cv::morphologyDefaultBorderValue());
-}
-
-void detect_points(const cv::UMat& srcMotionMaskGrey, vector<cv::Point2f>& points) {
-    static cv::Ptr<cv::FastFeatureDetector> detector = cv::FastFeatureDetector::create(1, false);
-    static vector<cv::KeyPoint> tmpKeyPoints;
-
-    tmpKeyPoints.clear();
-    detector->detect(srcMotionMaskGrey, tmpKeyPoints);
-
-    points.clear();
-    for (const auto &kp : tmpKeyPoints) {
-        points.push_back(kp.pt);
+//Quality is lowered automatically when the pipeline can't keep up with this frame rate. 0 never touches it.
+float target_fps = 0;
+
+//the quality controller is only created once there is a target
+void set_target_fps(float fps) {
+    static bool registered = false;
+    target_fps = std::max(fps, 0.0f);
+    if (target_fps == 0 && !registered)
+        return;
+
+    kb::viz2d::QualityController& quality = v2d->quality();
+    if (!registered) {
+        quality.addKnob("max_points", max_points, 10000, 40000, "optical flow");
+        quality.addKnob("kernel_size", kernel_size, 1, 2, "composite");
+        quality.addKnob("fg_scale", fg_scale, 0.2f, 0.05f, "motion mask");
+        registered = true;
     }
+    quality.setEnabled(target_fps > 0);
+    if (target_fps > 0)
+        quality.setBudget(1000.0f / target_fps);
 }
 
-bool detect_scene_change(const cv::UMat& srcMotionMaskGrey, const float thresh, const float theshDiff) {
-    static float last_movement = 0;
+void visualize_sparse_optical_flow(const cv::UMat &prevGrey, const cv::UMat &nextGrey, const vector<cv::Point2f> &detectedPoints, const float scaleFactor, const int maxStrokeSize, const cv::Scalar color, const int maxPoints, const float pointLossPercent) {
+    static kb::viz2d::SparseOpticalFlow flow;
+    static vector<cv::Vec4f> lines;
 
-    float movement = cv::countNonZero(srcMotionMaskGrey) / double(srcMotionMaskGrey.cols * srcMotionMaskGrey.rows);
-    float relation = movement > 0 && last_movement > 0 ? std::max(movement, last_movement) / std::min(movement, last_movement) : 0;
-    float relM = relation * log10(1.0f + (movement * 9.0));
-    float relLM = relation * log10(1.0f + (last_movement * 9.0));
+    flow.track(prevGrey, nextGrey, detectedPoints, scaleFactor, maxPoints, pointLossPercent, lines);
+    if (lines.empty())
+        return;
 
-    bool result = !((movement > 0 && last_movement > 0 && relation > 0)
-            && (relM < thresh && relLM < thresh && fabs(relM - relLM) < theshDiff));
-    last_movement = (last_movement + movement) / 2.0f;
-    return result;
-}
+    float strokeSize = maxStrokeSize * pow(flow.getHullArea() / (nextGrey.cols * nextGrey.rows), 0.33f);
 
-void visualize_sparse_optical_flow(const cv::UMat &prevGrey, const cv::UMat &nextGrey, vector<cv::Point2f> &detectedPoints, const float scaleFactor, const int maxStrokeSize, const cv::Scalar color, const int maxPoints, const float pointLossPercent) {
-    static vector<cv::Point2f> hull, prevPoints, nextPoints, newPoints;
-    static vector<cv::Point2f> upPrevPoints, upNextPoints;
-    static std::vector<uchar> status;
-    static std::vector<float> err;
-    static std::random_device rd;
-    static std::mt19937 g(rd());
-
-    if (detectedPoints.size() > 4) {
-        cv::convexHull(detectedPoints, hull);
-        float area = cv::contourArea(hull);
-        if (area > 0) {
-            float density = (detectedPoints.size() / area);
-            float strokeSize = maxStrokeSize * pow(area / (nextGrey.cols * nextGrey.rows), 0.33f);
-            size_t currentMaxPoints = ceil(density * maxPoints);
-
-            std::shuffle(prevPoints.begin(), prevPoints.end(), g);
-            prevPoints.resize(ceil(prevPoints.size() * (1.0f - (pointLossPercent / 100.0f))));
-
-            size_t copyn = std::min(detectedPoints.size(), (size_t(std::ceil(currentMaxPoints)) - prevPoints.size()));
-            if (prevPoints.size() < currentMaxPoints) {
-                std::copy(detectedPoints.begin(), detectedPoints.begin() + copyn, std::back_inserter(prevPoints));
-            }
+    //drawing has to happen on this thread
+    using namespace kb::viz2d::nvg;
+    beginPath();
+    strokeWidth(strokeSize);
+    strokeColor(color);
 
-            cv::calcOpticalFlowPyrLK(prevGrey, nextGrey, prevPoints, nextPoints, status, err);
-            newPoints.clear();
-            if (prevPoints.size() > 1 && nextPoints.size() > 1) {
-                upNextPoints.clear();
-                upPrevPoints.clear();
-                for (cv::Point2f pt : prevPoints) {
-                    upPrevPoints.push_back(pt /= scaleFactor);
-                }
-
-                for (cv::Point2f pt : nextPoints) {
-                    upNextPoints.push_back(pt /= scaleFactor);
-                }
-
-                using namespace kb::viz2d::nvg;
-                beginPath();
-                strokeWidth(strokeSize);
-                strokeColor(color);
-
-                for (size_t i = 0; i < prevPoints.size(); i++) {
-                    if (status[i] == 1 && err[i] < (1.0 / density) && upNextPoints[i].y >= 0 && upNextPoints[i].x >= 0 && upNextPoints[i].y < nextGrey.rows / scaleFactor && upNextPoints[i].x < nextGrey.cols / scaleFactor) {
-                        float len = hypot(fabs(upPrevPoints[i].x - upNextPoints[i].x), fabs(upPrevPoints[i].y - upNextPoints[i].y));
-                        if (len > 0 && len < sqrt(area)) {
-                            newPoints.push_back(nextPoints[i]);
-                            moveTo(upNextPoints[i].x, upNextPoints[i].y);
-                            lineTo(upPrevPoints[i].x, upPrevPoints[i].y);
-                        }
-                    }
-                }
-                stroke();
-            }
-            prevPoints = newPoints;
-        }
+    for (const auto& l : lines) {
+        moveTo(l[0], l[1]);
+        lineTo(l[2], l[3]);
     }
-}
-
-void bloom(const cv::UMat& src, cv::UMat &dst, int ksize = 3, int threshValue = 235, float gain = 4) {
-    static cv::UMat bgr;
-    static cv::UMat hls;
-    static cv::UMat ls16;
-    static cv::UMat ls;
-    static cv::UMat blur;
-    static std::vector<cv::UMat> hlsChannels;
-
-    cv::cvtColor(src, bgr, cv::COLOR_BGRA2RGB);
-    cv::cvtColor(bgr, hls, cv::COLOR_BGR2HLS);
-    cv::split(hls, hlsChannels);
-    cv::bitwise_not(hlsChannels[2], hlsChannels[2]);
-
-    cv::multiply(hlsChannels[1], hlsChannels[2], ls16, 1, CV_16U);
-    cv::divide(ls16, cv::Scalar(255.0), ls, 1, CV_8U);
-    cv::threshold(ls, blur, threshValue, 255, cv::THRESH_BINARY);
-
-    cv::boxFilter(blur, blur, -1, cv::Size(ksize, ksize), cv::Point(-1,-1), true, cv::BORDER_REPLICATE);
-    cv::cvtColor(blur, blur, cv::COLOR_GRAY2BGRA);
-
-    addWeighted(src, 1.0, blur, gain, 0, dst);
-}
-
-void glow_effect(const cv::UMat &src, cv::UMat &dst, const int ksize) {
-    static cv::UMat resize;
-    static cv::UMat blur;
-    static cv::UMat dst16;
-
-    cv::bitwise_not(src, dst);
-
-    //Resize for some extra performance
-    cv::resize(dst, resize, cv::Size(), 0.5, 0.5);
-    //Cheap blur
-    cv::boxFilter(resize, resize, -1, cv::Size(ksize, ksize), cv::Point(-1,-1), true, cv::BORDER_REPLICATE);
-    //Back to original size
-    cv::resize(resize, blur, src.size());
-
-    //Multiply the src image with a blurred version of itself
-    cv::multiply(dst, blur, dst16, 1, CV_16U);
-    //Normalize and convert back to CV_8U
-    cv::divide(dst16, cv::Scalar::all(255.0), dst, 1, CV_8U);
-
-    cv::bitwise_not(dst, dst);
-}
-
-void composite_layers(cv::UMat& background, const cv::UMat& foreground, const cv::UMat& frameBuffer, cv::UMat& dst, int kernelSize, float fgLossPercent, BackgroundModes bgMode, PostProcModes ppMode) {
-    static cv::UMat tmp;
-    static cv::UMat post;
-    static cv::UMat backgroundGrey;
-    static vector<cv::UMat> channels;
-
-    cv::subtract(foreground, cv::Scalar::all(255.0f * (fgLossPercent / 100.0f)), foreground);
-    cv::add(foreground, frameBuffer, foreground);
-
-    switch (bgMode) {
-    case GREY:
-        cv::cvtColor(background, backgroundGrey, cv::COLOR_BGRA2GRAY);
-        cv::cvtColor(backgroundGrey, background, cv::COLOR_GRAY2BGRA);
-        break;
-    case VALUE:
-        cv::cvtColor(background, tmp, cv::COLOR_BGRA2BGR);
-        cv::cvtColor(tmp, tmp, cv::COLOR_BGR2HSV);
-        split(tmp, channels);
-        cv::cvtColor(channels[2], background, cv::COLOR_GRAY2BGRA);
-        break;
-    case COLOR:
-        cv::cvtColor(background, background, cv::COLOR_BGRA2RGBA);
-        break;
-    case BLACK:
-        background = cv::Scalar::all(0);
-        break;
-    default:
-        break;
-    }
-
-    switch (ppMode) {
-    case GLOW:
-        glow_effect(foreground, post, kernelSize);
-        break;
-    case BLOOM:
-        bloom(foreground, post, kernelSize, bloom_thresh, bloom_gain);
-        break;
-    case NONE:
-        foreground.copyTo(post);
-        break;
-    default:
-        break;
-    }
-
-    cv::add(background, post, dst);
+    stroke();
 }
 
 void setup_gui(cv::Ptr<kb::viz2d::Viz2D> v2d, cv::Ptr<kb::viz2d::Viz2D> v2dMenu) {
@@ -410,6 +274,11 @@ void setup_gui(cv::Ptr<kb::viz2d::Viz2D> v2d, cv::Ptr<kb::viz2d::Viz2D> v2dMenu)
     v2d->makeFormVariable("Threshold", scene_change_thresh, 0.1f, 1.0f, true, "", "Peak threshold. Lowering it makes detection more sensitive");
     v2d->makeFormVariable("Threshold Diff", scene_change_thresh_diff, 0.1f, 1.0f, true, "", "Difference of peak thresholds. Lowering it makes detection more sensitive");
 
+    v2d->makeGroup("Quality");
+    v2d->makeFormVariable("Target FPS", target_fps, 0.0f, 240.0f, true, "fps", "Lower the quality automatically when the pipeline can't keep up with this frame rate. 0 disables it")->set_callback([](const float &f) {
+        set_target_fps(f);
+    });
+
     v2dMenu->makeWindow(8, 16, "Display");
 
     v2dMenu->makeGroup("Display");
@@ -429,42 +298,59 @@ void setup_gui(cv::Ptr<kb::viz2d::Viz2D> v2d, cv::Ptr<kb::viz2d::Viz2D> v2dMenu)
 #endif
 }
 
-void iteration() {
-    //BGRA
-    static cv::UMat background, down;
-    static cv::UMat foreground(v2d->getFrameBufferSize(), CV_8UC4, cv::Scalar::all(0));
-    //RGB
-    static cv::UMat menuFrame;
+void build_graph() {
+    using kb::viz2d::FrameGraph;
+    FrameGraph& graph = v2d->graph();
+    //BGRA. foreground is kept across frames, the others are taken from the frame arena by the stage that writes them.
+    static cv::UMat& background = graph.buf("background");
+    static cv::UMat& down = graph.buf("down");
+    static cv::UMat& foreground = graph.buf("foreground", v2d->getFrameBufferSize(), CV_8UC4, cv::Scalar::all(0));
     //GREY
-    static cv::UMat downPrevGrey, downNextGrey, downMotionMaskGrey;
+    static cv::UMat& downPrevGrey = graph.buf("downPrevGrey");
+    static cv::UMat& downNextGrey = graph.buf("downNextGrey");
+    static cv::UMat& downMotionMaskGrey = graph.buf("downMotionMaskGrey");
+    //host copy for the detection stage
+    static cv::Mat downMotionMaskMat;
     static vector<cv::Point2f> detectedPoints;
-
-    if(v2d->isAccelerated() != use_acceleration)
-        v2d->setAccelerated(use_acceleration);
+    static kb::viz2d::MotionDetector motion;
 
 #ifndef __EMSCRIPTEN__
-    if(!v2d->capture())
-        exit(0);
+    graph.capture();
 #endif
 
-    v2d->clgl([&](cv::UMat& frameBuffer) {
-        cv::resize(frameBuffer, down, cv::Size(v2d->getFrameBufferSize().width * fg_scale, v2d->getFrameBufferSize().height * fg_scale));
+    graph.clgl("downscale", {}, {"down", "background"}, [&](cv::UMat& frameBuffer) {
+        cv::Size downSize(v2d->getFrameBufferSize().width * fg_scale, v2d->getFrameBufferSize().height * fg_scale);
+        v2d->graph().acquire("down", downSize, frameBuffer.type());
+        v2d->graph().acquire("background", frameBuffer.size(), frameBuffer.type());
+        cv::resize(frameBuffer, down, downSize);
         frameBuffer.copyTo(background);
-    });
+    }, cv::ACCESS_READ);
 
-    v2d->cl([&]() {
+    graph.cl("motion mask", {"down"}, {"downNextGrey", "downMotionMaskGrey"}, [&]() {
+        v2d->graph().acquire("downNextGrey", down.size(), CV_8UC1);
+        v2d->graph().acquire("downMotionMaskGrey", down.size(), CV_8UC1);
         cv::cvtColor(down, downNextGrey, cv::COLOR_RGBA2GRAY);
         //Subtract the background to create a motion mask
-        prepare_motion_mask(downNextGrey, downMotionMaskGrey);
-        //Detect trackable points in the motion mask
-        detect_points(downMotionMaskGrey, detectedPoints);
+        motion.mask(downNextGrey, downMotionMaskGrey);
+        //download here. the CPU stage runs on another thread and shouldn't touch OpenCL buffers.
+        downMotionMaskGrey.copyTo(downMotionMaskMat);
+    });
+
+    //Detect trackable points in the motion mask. runs on the CPU anyway, so it overlaps with preparing the background.
+    graph.cpu("detect points", {"downMotionMaskGrey"}, {"detectedPoints"}, [&]() {
+        kb::viz2d::detect_points(downMotionMaskMat, detectedPoints);
     });
 
-    v2d->nvg([&](const cv::Size& sz) {
+    graph.cl("background", {"background"}, {"background"}, [&]() {
+        kb::viz2d::prepare_background(v2d->arena(), background, background_mode);
+    });
+
+    graph.nvg("optical flow", {"downPrevGrey", "downNextGrey", "downMotionMaskGrey", "detectedPoints"}, {}, [&](const cv::Size& sz) {
         v2d->clear();
         if (!downPrevGrey.empty()) {
             //We don't want the algorithm to get out of hand when there is a scene change, so we suppress it when we detect one.
-            if (!detect_scene_change(downMotionMaskGrey, scene_change_thresh, scene_change_thresh_diff)) {
+            //the scale might just have changed
+            if (downPrevGrey.size() == downNextGrey.size() && !motion.detectSceneChange(downMotionMaskGrey, scene_change_thresh, scene_change_thresh_diff)) {
                 //Visualize the sparse optical flow using nanovg
                 cv::Scalar color = cv::Scalar(effect_color.b() * 255.0f, effect_color.g() * 255.0f, effect_color.r() * 255.0f, alpha * 255.0f);
                 visualize_sparse_optical_flow(downPrevGrey, downNextGrey, detectedPoints, fg_scale, max_stroke, color, max_points, point_loss);
@@ -472,38 +358,56 @@ void iteration() {
         }
     });
 
-    downPrevGrey = downNextGrey.clone();
+    graph.cl("keep previous", {"downNextGrey"}, {"downPrevGrey"}, [&]() {
+        downNextGrey.copyTo(downPrevGrey);
+    });
 
-    v2d->clgl([&](cv::UMat& frameBuffer){
+    graph.clgl("composite", {"background", "foreground"}, {"foreground"}, [&](cv::UMat& frameBuffer) {
         //Put it all together (OpenCL)
-        composite_layers(background, foreground, frameBuffer, frameBuffer, kernel_size, fg_loss, background_mode, post_proc_mode);
-#ifndef __EMSCRIPTEN__
-        cvtColor(frameBuffer, menuFrame, cv::COLOR_BGRA2RGB);
-#endif
+        kb::viz2d::composite_layers(v2d->arena(), background, foreground, frameBuffer, frameBuffer, kernel_size, fg_loss, post_proc_mode, bloom_thresh, bloom_gain);
     });
 
-    update_fps(v2d, show_fps);
+    graph.task("fps", {FrameGraph::FRAMEBUFFER}, {FrameGraph::FRAMEBUFFER}, [&]() {
+        update_fps(v2d, show_fps);
+    });
 
 #ifndef __EMSCRIPTEN__
-    v2d->write();
+    graph.write();
 
-    v2dMenu->capture([&](cv::UMat& videoFrame) {
-        menuFrame.copyTo(videoFrame);
-    });
+    graph.task("menu", {FrameGraph::FRAMEBUFFER}, {}, [&]() {
+        //the texture of v2d is shared. scale it on the GPU, unless the menu skips this frame anyway.
+        if (v2dMenu->willPresent())
+            v2dMenu->blitFrom(*v2d);
 
-    if(!v2dMenu->display())
-        exit(0);
+        if(!v2dMenu->display())
+            exit(0);
+    });
 #endif
 
     //If onscreen rendering is enabled it displays the framebuffer in the native window. Returns false if the window was closed.
-    if(!v2d->display())
+    graph.display();
+}
+
+void iteration() {
+    if(v2d->isAccelerated() != use_acceleration)
+        v2d->setAccelerated(use_acceleration);
+
+    if (v2d->graph().empty())
+        build_graph();
+
+    if(!v2d->graph().run())
         exit(0);
 }
+
 int main(int argc, char **argv) {
     using namespace kb::viz2d;
 #ifndef __EMSCRIPTEN__
-    if (argc != 2) {
-        std::cerr << "Usage: optflow <input-video-file>" << endl;
+    bool y4m = argc == 4 && string(argv[1]) == "--y4m";
+    bool cache = argc == 4 && string(argv[1]) == "--cache";
+    if (argc != 2 && !y4m && !cache) {
+        std::cerr << "Usage: optflow <input-video-file|bus:<frame-bus-name>|--synthetic|--y4m <input> <output>|--cache <cache-file> <input-video-file>>" << endl;
+        std::cerr << "--y4m reads and writes YUV4MPEG2 from and to files or pipes. - is stdin respectively stdout." << endl;
+        std::cerr << "--cache decodes the input once into the cache file and reads the decoded frames from there in later runs." << endl;
         exit(1);
     }
 #endif
@@ -520,18 +424,67 @@ int main(int argc, char **argv) {
     }
 
 #ifndef __EMSCRIPTEN__
-    auto capture = v2d->makeVACapture(argv[1], VA_HW_DEVICE_INDEX);
+    float fps, width, height;
+    if (string(argv[1]) == "--synthetic") {
+        //no decoding and no disk I/O, so only the pipeline itself is measured
+        auto* source = new SyntheticSource(cv::Size(WIDTH, HEIGHT), 30, 0, SYNTHETIC_SCENE_LENGTH);
+        fps = source->getFPS();
+        width = WIDTH;
+        height = HEIGHT;
+        v2d->setSource(source);
+    } else if (y4m) {
+        auto* source = new PipeSource(argv[2], PIPE_Y4M);
+        if (!source->isOpened()) {
+            cerr << "ERROR! Unable to open video input" << endl;
+            exit(-1);
+        }
+        fps = source->getFPS();
+        width = source->getSize().width;
+        height = source->getSize().height;
+        v2d->setSource(source);
+    } else if (cache) {
+        FrameCacheSource* source = nullptr;
+        if (!make_frame_cache(argv[3], argv[2]) || !(source = new FrameCacheSource(argv[2]))->isOpened()) {
+            cerr << "ERROR! Unable to open video input" << endl;
+            exit(-1);
+        }
+        fps = source->getFPS();
+        width = source->getSize().width;
+        height = source->getSize().height;
+        v2d->setSource(source);
+    } else if (string(argv[1]).rfind("bus:", 0) == 0) {
+        //frames decoded by another process (see src/framebus)
+        auto* source = new FrameBusSource(string(argv[1]).substr(4));
+        if (!source->isOpened()) {
+            cerr << "ERROR! Unable to open frame bus" << endl;
+            exit(-1);
+        }
+        fps = source->getFPS();
+        width = source->getSize().width;
+        height = source->getSize().height;
+        v2d->setSource(source);
+    } else {
+        auto capture = v2d->makeVACapture(argv[1], VA_HW_DEVICE_INDEX);
+
+        if (!capture.isOpened()) {
+            cerr << "ERROR! Unable to open video input" << endl;
+            exit(-1);
+        }
 
-    if (!capture.isOpened()) {
-        cerr << "ERROR! Unable to open video input" << endl;
-        exit(-1);
+        fps = capture.get(cv::CAP_PROP_FPS);
+        width = capture.get(cv::CAP_PROP_FRAME_WIDTH);
+        height = capture.get(cv::CAP_PROP_FRAME_HEIGHT);
     }
-
-    float fps = capture.get(cv::CAP_PROP_FPS);
-    float width = capture.get(cv::CAP_PROP_FRAME_WIDTH);
-    float height = capture.get(cv::CAP_PROP_FRAME_HEIGHT);
-
-    v2d->makeVAWriter(OUTPUT_FILENAME, cv::VideoWriter::fourcc('V', 'P', '9', '0'), fps, cv::Size(width, height), VA_HW_DEVICE_INDEX);
+    v2d->setPrefetchDepth(PREFETCH_DEPTH);
+
+    if (y4m)
+        v2d->setSink(new PipeSink(argv[3], PIPE_Y4M, cv::Size(width, height), fps));
+    else
+        v2d->makeVAWriter(OUTPUT_FILENAME, cv::VideoWriter::fourcc('V', 'P', '9', '0'), fps, cv::Size(width, height), VA_HW_DEVICE_INDEX);
+    v2d->setAsyncWrite(WRITER_QUEUE_DEPTH);
+    v2d->setDisplayRate(DISPLAY_RATE);
+    v2dMenu->setDisplayRate(DISPLAY_RATE);
+    set_target_fps(target_fps);
     while (true) {
         iteration();
     }
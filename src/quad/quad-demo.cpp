@@ -2,6 +2,8 @@
 
 #include "../common/viz2d.hpp"
 #include "../common/util.hpp"
+#include "../common/framearena.hpp"
+#include "../common/effects.hpp"
 
 constexpr long unsigned int WIDTH = 1920;
 constexpr long unsigned int HEIGHT = 1080;
@@ -9,6 +11,7 @@ constexpr double FPS = 60;
 constexpr bool OFFSCREEN = false;
 constexpr const char* OUTPUT_FILENAME = "tetra-demo.mkv";
 constexpr const int VA_HW_DEVICE_INDEX = 0;
+constexpr size_t WRITER_QUEUE_DEPTH = 3;
 const unsigned long DIAG = hypot(double(WIDTH), double(HEIGHT));
 
 const int kernel_size = std::max(int(DIAG / 138 % 2 == 0 ? DIAG / 138 + 1 : DIAG / 138), 1);
@@ -184,28 +187,6 @@ void render_scene(const cv::Size& sz) {
     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
 }
 
-void glow_effect(const cv::UMat &src, cv::UMat &dst, const int ksize) {
-    static cv::UMat resize;
-    static cv::UMat blur;
-    static cv::UMat dst16;
-
-    cv::bitwise_not(src, dst);
-
-    //Resize for some extra performance
-    cv::resize(dst, resize, cv::Size(), 0.5, 0.5);
-    //Cheap blur
-    cv::boxFilter(resize, resize, -1, cv::Size(ksize, ksize), cv::Point(-1,-1), true, cv::BORDER_REPLICATE);
-    //Back to original size
-    cv::resize(resize, blur, src.size());
-
-    //Multiply the src image with a blurred version of itself
-    cv::multiply(dst, blur, dst16, 1, CV_16U);
-    //Normalize and convert back to CV_8U
-    cv::divide(dst16, cv::Scalar::all(255.0), dst, 1, CV_8U);
-
-    cv::bitwise_not(dst, dst);
-}
-
 cv::Ptr<kb::viz2d::Viz2D> v2d = new kb::viz2d::Viz2D(cv::Size(WIDTH, HEIGHT), cv::Size(WIDTH, HEIGHT), OFFSCREEN, "Tetra Demo");
 
 void iteration() {
@@ -215,7 +196,7 @@ void iteration() {
     //Aquire the frame buffer for use by OpenCL
     v2d->clgl([](cv::UMat &frameBuffer) {
         //Glow effect (OpenCL)
-        glow_effect(frameBuffer, frameBuffer, kernel_size);
+        kb::viz2d::glow_effect(v2d->arena(), frameBuffer, frameBuffer, kernel_size);
     });
 
     update_fps(v2d, false);
@@ -235,6 +216,7 @@ int main(int argc, char **argv) {
         v2d->setVisible(true);
 #ifndef __EMSCRIPTEN__
     v2d->makeVAWriter(OUTPUT_FILENAME, cv::VideoWriter::fourcc('V', 'P', '9', '0'), FPS, v2d->getFrameBufferSize(), 0);
+    v2d->setAsyncWrite(WRITER_QUEUE_DEPTH);
 #endif
 
     v2d->gl(init_scene);
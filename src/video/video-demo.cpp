@@ -2,12 +2,19 @@
 
 #include "../common/viz2d.hpp"
 #include "../common/util.hpp"
+#include "../common/framearena.hpp"
+#include "../common/effects.hpp"
+#include "../common/syntheticsource.hpp"
 
 #include <string>
 
 constexpr long unsigned int WIDTH = 1920;
 constexpr long unsigned int HEIGHT = 1080;
 constexpr const int VA_HW_DEVICE_INDEX = 0;
+constexpr size_t PREFETCH_DEPTH = 3;
+constexpr size_t WRITER_QUEUE_DEPTH = 3;
+//the window is refreshed at this rate while the pipeline runs as fast as it can. 0 shows every frame.
+constexpr float DISPLAY_RATE = 30;
 constexpr bool OFFSCREEN = false;
 constexpr const char* OUTPUT_FILENAME = "video-demo.mkv";
 constexpr unsigned long DIAG = hypot(double(WIDTH), double(HEIGHT));
@@ -58,33 +65,11 @@ void render_scene(const cv::Size& sz) {
     glEnd();
 }
 
-void glow_effect(const cv::UMat &src, cv::UMat &dst, const int ksize) {
-    static cv::UMat resize;
-    static cv::UMat blur;
-    static cv::UMat dst16;
-
-    cv::bitwise_not(src, dst);
-
-    //Resize for some extra performance
-    cv::resize(dst, resize, cv::Size(), 0.5, 0.5);
-    //Cheap blur
-    cv::boxFilter(resize, resize, -1, cv::Size(ksize, ksize), cv::Point(-1,-1), true, cv::BORDER_REPLICATE);
-    //Back to original size
-    cv::resize(resize, blur, src.size());
-
-    //Multiply the src image with a blurred version of itself
-    cv::multiply(dst, blur, dst16, 1, CV_16U);
-    //Normalize and convert back to CV_8U
-    cv::divide(dst16, cv::Scalar::all(255.0), dst, 1, CV_8U);
-
-    cv::bitwise_not(dst, dst);
-}
-
 int main(int argc, char **argv) {
     using namespace kb::viz2d;
 
     if(argc != 2) {
-        cerr << "Usage: video-demo <video-file>" << endl;
+        cerr << "Usage: video-demo <video-file|--synthetic>" << endl;
         exit(1);
     }
     cv::Ptr<Viz2D> v2d = new Viz2D(cv::Size(WIDTH, HEIGHT), cv::Size(WIDTH, HEIGHT), OFFSCREEN, "Video Demo");
@@ -92,17 +77,29 @@ int main(int argc, char **argv) {
     if(!v2d->isOffscreen())
         v2d->setVisible(true);
 
-    auto capture = v2d->makeVACapture(argv[1], VA_HW_DEVICE_INDEX);
-
-    if (!capture.isOpened()) {
-        cerr << "ERROR! Unable to open video input" << endl;
-        exit(-1);
+    float fps, width, height;
+    if (string(argv[1]) == "--synthetic") {
+        auto* source = new SyntheticSource(cv::Size(WIDTH, HEIGHT));
+        fps = source->getFPS();
+        width = WIDTH;
+        height = HEIGHT;
+        v2d->setSource(source);
+    } else {
+        auto capture = v2d->makeVACapture(argv[1], VA_HW_DEVICE_INDEX);
+
+        if (!capture.isOpened()) {
+            cerr << "ERROR! Unable to open video input" << endl;
+            exit(-1);
+        }
+
+        fps = capture.get(cv::CAP_PROP_FPS);
+        width = capture.get(cv::CAP_PROP_FRAME_WIDTH);
+        height = capture.get(cv::CAP_PROP_FRAME_HEIGHT);
     }
-
-    float fps = capture.get(cv::CAP_PROP_FPS);
-    float width = capture.get(cv::CAP_PROP_FRAME_WIDTH);
-    float height = capture.get(cv::CAP_PROP_FRAME_HEIGHT);
+    v2d->setPrefetchDepth(PREFETCH_DEPTH);
     v2d->makeVAWriter(OUTPUT_FILENAME, cv::VideoWriter::fourcc('V', 'P', '9', '0'), fps, cv::Size(width, height), VA_HW_DEVICE_INDEX);
+    v2d->setAsyncWrite(WRITER_QUEUE_DEPTH);
+    v2d->setDisplayRate(DISPLAY_RATE);
 
     v2d->gl(init_scene);
 
@@ -114,7 +111,7 @@ int main(int argc, char **argv) {
 
         v2d->clgl([&](cv::UMat& frameBuffer){
             //Glow effect (OpenCL)
-            glow_effect(frameBuffer, frameBuffer, kernel_size);
+            kb::viz2d::glow_effect(v2d->arena(), frameBuffer, frameBuffer, kernel_size);
         });
 
         update_fps(v2d, true);